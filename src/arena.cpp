@@ -0,0 +1,58 @@
+#include "arena.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    std::atomic<size_t> n_allocations = 0;
+}
+
+frame_arena frame_strings;
+
+size_t heap_allocations() { return n_allocations.load(std::memory_order_relaxed); }
+
+char* frame_arena::allocate(size_t n) {
+    bytes += n;
+    // Find a block with enough room, starting with the current one.
+    while (block < blocks.size() && used + n > sizes[block]) {
+        ++block;
+        used = 0;
+    }
+    if (block == blocks.size()) {
+        auto size = std::max(block_size, n);
+        blocks.emplace_back(new char[size]);
+        sizes.push_back(size);
+        used = 0;
+    }
+    auto result = blocks[block].get() + used;
+    used += n;
+    return result;
+}
+
+void frame_arena::reset() {
+    auto now = heap_allocations();
+    last_allocations = now - mark;
+    last_bytes       = bytes;
+    mark  = now;
+    block = 0;
+    used  = 0;
+    bytes = 0;
+}
+
+size_t frame_arena::capacity() const {
+    size_t result = 0;
+    for (auto size: sizes) result += size;
+    return result;
+}
+
+// Count heap allocations for the debug window.
+void* operator new(std::size_t n) {
+    n_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto ptr = std::malloc(n ? n : 1)) return ptr;
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+// Bump allocator for data living until the end of the current frame. Blocks
+// are kept across frames, so a warmed-up frame does not touch the heap.
+struct frame_arena {
+    static constexpr size_t block_size = 64*1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<size_t> sizes;
+    size_t block = 0;              // Block currently bumped
+    size_t used  = 0;              // Bytes taken from the current block
+    size_t bytes = 0;              // Bytes handed out this frame
+
+    // Statistics of the previous frame
+    size_t last_bytes       = 0;
+    size_t last_allocations = 0;   // Heap allocations on all threads
+    size_t mark             = 0;
+
+    char* allocate(size_t n);
+    // Start a new frame, invalidating everything handed out so far.
+    void reset();
+    size_t capacity() const;
+
+    // Format into the arena; the result is valid until the next `reset`.
+    template<typename... Ts>
+    const char* format(fmt::format_string<Ts...> fmt, Ts&&... args) {
+        auto n   = fmt::formatted_size(fmt, args...);
+        auto buf = allocate(n + 1);
+        auto end = fmt::format_to(buf, fmt, std::forward<Ts>(args)...);
+        *end = '\0';
+        return buf;
+    }
+};
+
+// Number of calls to global operator new since startup.
+size_t heap_allocations();
+
+extern frame_arena frame_strings;
+
+template<typename... Ts>
+const char* frame_format(fmt::format_string<Ts...> fmt, Ts&&... args) { return frame_strings.format(fmt, std::forward<Ts>(args)...); }
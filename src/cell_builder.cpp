@@ -1,5 +1,16 @@
 #include "cell_builder.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <numbers>
+#include <optional>
+#include <string_view>
+
+#include <arbor/morph/cv_data.hpp>
+#include <arbor/morph/embed_pwlin.hpp>
+
+#include "task.hpp"
 #include "utils.hpp"
 
 cell_builder::cell_builder()
@@ -7,56 +18,205 @@ cell_builder::cell_builder()
 cell_builder::cell_builder(const arb::morphology &t)
     : morph{t}, pwlin{morph}, labels{}, provider{morph, labels} {};
 
-void cell_builder::make_label_dict(std::vector<ls_def>& locsets,
-                                   std::vector<rg_def>& regions,
-                                   std::vector<ie_def>& iexprs) {
-  labels = {};
-  for (auto& item: locsets) {
-    if (item.data) {
-      if (labels.locset(item.name)) {
-        item.state   = def_state::error;
-        item.message = "Duplicate name; ignored.";
-      } else {
-        try {
-          labels.set(item.name, item.data.value());
-        } catch (const arb::arbor_exception& e) {
-          item.state   = def_state::error;
-          item.message = e.what();
-        }
+cell_builder cell_builder::label_worker() const {
+  cell_builder result;
+  result.morph         = morph;
+  result.pwlin         = pwlin;
+  result.memos         = memos;
+  result.policy        = policy;
+  result.label_version = label_version;
+  result.stale_labels  = true;
+  return result;
+}
+
+namespace {
+struct label_node {
+  label_key key;
+  std::string definition;
+  std::variant<arb::region, arb::locset, arb::iexpr> expr;
+  std::function<void(const std::string&)> fail;
+  std::vector<size_t> deps;
+  bool dirty  = false;
+  bool done   = false;
+  bool failed = false;
+};
+
+template<typename Def>
+void add_label_nodes(std::vector<Def>& defs, label_kind kind,
+                     arb::label_dict& names,
+                     std::vector<label_node>& nodes,
+                     std::unordered_map<label_key, size_t>& index) {
+  for (auto& item: defs) {
+    // Retry failed labels, their dependencies might have been fixed.
+    if (item.state == def_state::error) item.update();
+    if (!item.data) continue;
+    label_key key{kind, item.name};
+    if (index.contains(key)) {
+      item.state   = def_state::error;
+      item.message = "Duplicate name; ignored.";
+      continue;
+    }
+    try {
+      names.set(item.name, item.data.value());
+    } catch (const arb::arbor_exception& e) {
+      item.state   = def_state::error;
+      item.message = e.what();
+      continue;
+    }
+    index[key] = nodes.size();
+    nodes.push_back({.key=key,
+                     .definition=item.definition,
+                     .expr=item.data.value(),
+                     .fail=[&item](const std::string& m) { item.set_error(m); }});
+  }
+}
+}
+
+std::vector<label_key> label_references(const std::string& def) {
+  constexpr auto ws = " \t\r\n";
+  std::vector<label_key> result;
+  for (auto pos = def.find('('); pos != std::string::npos; pos = def.find('(', pos + 1)) {
+    auto beg = def.find_first_not_of(ws, pos + 1);
+    if (beg == std::string::npos) break;
+    auto end = def.find_first_of(" \t\r\n\"()", beg);
+    if (end == std::string::npos) break;
+    auto head = std::string_view{def}.substr(beg, end - beg);
+    label_kind kind;
+    if (head == "region")      kind = label_kind::region;
+    else if (head == "locset") kind = label_kind::locset;
+    else if (head == "iexpr")  kind = label_kind::iexpr;
+    else continue;
+    auto open = def.find_first_not_of(ws, end);
+    if (open == std::string::npos || def[open] != '"') continue;
+    auto close = def.find('"', open + 1);
+    if (close == std::string::npos) break;
+    result.emplace_back(kind, def.substr(open + 1, close - open - 1));
+  }
+  return result;
+}
+
+std::unordered_set<label_key> cell_builder::make_label_dict(std::vector<ls_def>& locsets,
+                                                            std::vector<rg_def>& regions,
+                                                            std::vector<ie_def>& iexprs) {
+  std::vector<label_node> nodes;
+  std::unordered_map<label_key, size_t> index;
+  {
+    arb::label_dict names;
+    add_label_nodes(locsets, label_kind::locset, names, nodes, index);
+    add_label_nodes(regions, label_kind::region, names, nodes, index);
+    add_label_nodes(iexprs,  label_kind::iexpr,  names, nodes, index);
+  }
+
+  // A label is dirty if it is new, its definition changed, or it references
+  // a label that is gone; dirtiness then spreads to all dependents.
+  std::vector<std::vector<size_t>> dependents(nodes.size());
+  std::vector<size_t> queue;
+  for (auto ix = 0ul; ix < nodes.size(); ++ix) {
+    auto& node = nodes[ix];
+    auto memo  = memos.find(node.key);
+    node.dirty = (memo == memos.end()) || (memo->second->definition != node.definition);
+    for (const auto& ref: label_references(node.definition)) {
+      if (auto it = index.find(ref); it != index.end()) {
+        node.deps.push_back(it->second);
+        dependents[it->second].push_back(ix);
+      } else if (memos.contains(ref)) {
+        node.dirty = true;
       }
     }
+    if (node.dirty) queue.push_back(ix);
   }
-  for (auto& item: regions) {
-    if (item.data) {
-      if (labels.region(item.name)) {
-        item.state   = def_state::error;
-        item.message = "Duplicate name; ignored.";
-      } else {
-        try {
-          labels.set(item.name, item.data.value());
-        } catch (const arb::arbor_exception& e) {
-          item.state   = def_state::error;
-          item.message = e.what();
-        }
+  while (!queue.empty()) {
+    auto ix = queue.back();
+    queue.pop_back();
+    for (auto dx: dependents[ix]) {
+      if (!nodes[dx].dirty) {
+        nodes[dx].dirty = true;
+        queue.push_back(dx);
       }
     }
   }
-  for (auto& item: iexprs) {
-    if (item.data) {
-      if (labels.iexpr(item.name)) {
-        item.state   = def_state::error;
-        item.message = "Duplicate name; ignored.";
+
+  std::unordered_set<label_key> result;
+  for (const auto& [key, memo]: memos) {
+    if (!index.contains(key)) result.insert(key);
+  }
+  std::erase_if(memos, [&](const auto& kv) { return !index.contains(kv.first) || nodes[index.at(kv.first)].dirty; });
+
+  std::vector<size_t> pending;
+  for (auto ix = 0ul; ix < nodes.size(); ++ix) {
+    if (nodes[ix].dirty) pending.push_back(ix);
+  }
+  auto changed = !pending.empty() || !result.empty();
+  if (!changed && !stale_labels) return result;
+
+  // Clean labels enter the provider as memoised extents and locations.
+  concrete = {};
+  for (auto& node: nodes) {
+    if (node.dirty) continue;
+    std::visit([&](const auto& v) { concrete.set(node.key.second, v); }, memos.at(node.key)->value);
+    node.done = true;
+  }
+
+  // Evaluate dirty labels level by level, each once all labels it references are done.
+  while (!pending.empty()) {
+    std::vector<size_t> ready, blocked;
+    for (auto ix: pending) {
+      const auto& deps = nodes[ix].deps;
+      auto ok = std::all_of(deps.begin(), deps.end(), [&](auto dx) { return nodes[dx].done; });
+      (ok ? ready : blocked).push_back(ix);
+    }
+    if (ready.empty()) {
+      for (auto ix: blocked) {
+        auto& node = nodes[ix];
+        node.fail("Circular definition.");
+        node.failed = node.done = true;
+        result.insert(node.key);
+      }
+      break;
+    }
+    arb::mprovider level{morph, concrete};
+    std::vector<std::optional<std::variant<arb::region, arb::locset, arb::iexpr>>> values(ready.size());
+    std::vector<std::string> errors(ready.size());
+    parallel_for(ready.size(), [&](size_t ix) {
+      try {
+        std::visit([&](const auto& expr) {
+          using T = std::decay_t<decltype(expr)>;
+          if constexpr (std::is_same_v<T, arb::iexpr>) {
+            arb::thingify(expr, level);
+            values[ix] = expr;
+          } else {
+            values[ix] = T{arb::thingify(expr, level)};
+          }
+        }, nodes[ready[ix]].expr);
+      } catch (const arb::arbor_exception& e) {
+        errors[ix] = e.what();
+      }
+    });
+    for (auto ix = 0ul; ix < ready.size(); ++ix) {
+      auto& node = nodes[ready[ix]];
+      node.done = true;
+      result.insert(node.key);
+      if (values[ix]) {
+        std::visit([&](const auto& v) { concrete.set(node.key.second, v); }, values[ix].value());
+        memos.insert_or_assign(node.key, std::make_shared<const label_memo>(label_memo{node.definition, std::move(values[ix].value())}));
       } else {
-        try {
-          labels.set(item.name, item.data.value());
-        } catch (const arb::arbor_exception& e) {
-          item.state   = def_state::error;
-          item.message = e.what();
-        }
+        node.fail(errors[ix]);
+        node.failed = true;
       }
     }
+    pending = std::move(blocked);
   }
-  provider = {morph, labels};
+
+  labels = {};
+  if (changed) ++label_version;
+  stale_labels = false;
+  for (const auto& node: nodes) {
+    if (node.failed) continue;
+    std::visit([&](const auto& v) { labels.set(node.key.second, v); }, node.expr);
+  }
+  provider = {morph, concrete};
+  log_debug("Label dictionary: {} labels, {} re-evaluated", nodes.size(), result.size());
+  return result;
 }
 
 std::vector<arb::msegment> cell_builder::make_segments(const arb::region& region) {
@@ -66,41 +226,78 @@ std::vector<arb::msegment> cell_builder::make_segments(const arb::region& region
   return result;
 }
 
+// From cumulative segment lengths.
+std::vector<segment_span> cell_builder::segment_spans() const {
+  std::vector<segment_span> spans;
+  for (arb::msize_t branch = 0; branch < morph.num_branches(); ++branch) {
+    const auto& segments = morph.branch_segments(branch);
+    auto length = 0.0;
+    for (const auto& seg: segments) length += distance(seg.prox, seg.dist);
+    auto scale = length > 0 ? 1.0/length : 0.0;
+    auto pos   = 0.0;
+    for (const auto& seg: segments) {
+      auto next = pos + distance(seg.prox, seg.dist);
+      spans.push_back({branch, unsigned(seg.id), pos*scale, std::min(next*scale, 1.0)});
+      pos = next;
+    }
+  }
+  return spans;
+}
+
+std::vector<std::pair<unsigned, unsigned>> cell_builder::make_cable_map(const arb::mcable_list& cables) const {
+  // Cables per branch, ordered by position
+  std::vector<std::vector<std::pair<arb::mcable, unsigned>>> by_branch(morph.num_branches());
+  for (auto ix = 0u; ix < cables.size(); ++ix) {
+    const auto& cable = cables[ix];
+    if (cable.branch < by_branch.size()) by_branch[cable.branch].emplace_back(cable, ix);
+  }
+  for (auto& branch: by_branch) {
+    std::sort(branch.begin(), branch.end(), [](const auto& l, const auto& r) { return l.first.prox_pos < r.first.prox_pos; });
+  }
+  unsigned none = cables.size();
+  auto find = [&](arb::msize_t branch, double pos) -> unsigned {
+    const auto& cs = by_branch[branch];
+    auto it = std::upper_bound(cs.begin(), cs.end(), pos, [](double p, const auto& c) { return p < c.first.prox_pos; });
+    if (it == cs.begin()) return none;
+    --it;
+    return pos <= it->first.dist_pos ? it->second : none;
+  };
+  std::vector<std::pair<unsigned, unsigned>> result;
+  for (const auto& [branch, id, prox, dist]: segment_spans()) {
+    if (id >= result.size()) result.resize(id + 1, {none, none});
+    // Sample just inside the segment, its ends may sit on CV boundaries.
+    auto eps = 0.01*(dist - prox);
+    result[id] = {find(branch, prox + eps), find(branch, dist - eps)};
+  }
+  return result;
+}
+
 iexpr_info cell_builder::make_iexpr(const arb::iexpr& expr) {
-  auto all    = pwlin.all_segments(thingify(arb::reg::all(), provider));
-  auto iex    = arb::thingify(expr, provider);
+  auto iex = arb::thingify(expr, provider);
+  auto spans = segment_spans();
+  auto n_segments = 0ul;
+  for (const auto& span: spans) n_segments = std::max<size_t>(n_segments, span.id + 1);
+
   auto result = iexpr_info{};
-  for (const auto& seg: all) {
-    const auto& [px, py, pz, pr] = seg.prox;
-    const auto& [dx, dy, dz, dr] = seg.dist;
-    const auto& [plocs, pdel]    = pwlin.all_closest(px, py, pz);
-    const auto& [dlocs, ddel]    = pwlin.all_closest(dx, dy, dz);
-    bool found = false;
-    for (const auto& dloc: dlocs) {
-      for (const auto& ploc: plocs) {
-        if (dloc.branch == ploc.branch) {
-          float dval = iex->eval(provider, {dloc.branch, dloc.pos, dloc.pos});
-          float pval = iex->eval(provider, {ploc.branch, ploc.pos, ploc.pos});
-          // TODO: This is rather adhoc
-
-          result.min = std::min(std::min(pval, dval), result.min);
-          result.max = std::max(std::max(pval, dval), result.max);
-          result.values[seg.id] = {pval, dval};
-          found = true;
-          break;
-        }
-      }
-    }
-    if (!found) log_error("no matching");
+  result.values.resize(n_segments, {0.0f, 0.0f});
+  parallel_for(spans.size(), [&](size_t ix) {
+    const auto& [branch, id, prox, dist] = spans[ix];
+    float pval = iex->eval(provider, {branch, prox, prox});
+    float dval = iex->eval(provider, {branch, dist, dist});
+    result.values[id] = {pval, dval};
+  }, 1024);
+  for (const auto& [pval, dval]: result.values) {
+    result.min = std::min({pval, dval, result.min});
+    result.max = std::max({pval, dval, result.max});
   }
 
   // Normalise colour lookups
   auto scal = 0.0f;
   if (result.min != result.max) scal = 1/(result.max - result.min);
   log_debug("IExpr has min {} max {} scale {}", result.min, result.max, scal);
-  for (auto& [k, v]: result.values) {
-    v.first  = (v.first  - result.min)*scal;
-    v.second = (v.second - result.min)*scal;
+  for (auto& [p, d]: result.values) {
+    p = (p - result.min)*scal;
+    d = (d - result.min)*scal;
   }
   return result;
 }
@@ -117,7 +314,117 @@ std::vector<glm::vec3> cell_builder::make_points(const arb::locset& locset) {
   return points;
 }
 
-std::vector<glm::vec3> cell_builder::make_boundary(const arb::cv_policy& cv) {
-  auto cell = arb::cable_cell(morph, {}, labels);
-  return make_points(cv.cv_boundary_points(cell));
+cv_discretisation cell_builder::make_discretisation(const arb::cv_policy& cv, double Ra, double Cm,
+                                                   const std::vector<cv_parameters>& regions) {
+  constexpr size_t n_bins = 32;
+  constexpr double f_lambda = 100.0; // Hz, as in NEURON's d_lambda rule
+  cv_discretisation result;
+  auto cell   = arb::cable_cell(morph, {}, labels);
+  auto points = cv.cv_boundary_points(cell);
+  result.boundaries = make_points(points);
+
+  auto data = arb::cell_cv_data(cell, points);
+  const auto& embedding = cell.embedding();
+  result.n_cv = data.size();
+  std::vector<std::pair<arb::mcable_list, const cv_parameters*>> painted;
+  for (const auto& rg: regions) {
+    if (rg.Ra || rg.Cm) painted.emplace_back(thingify(rg.region, cell.provider()).cables(), &rg);
+  }
+  std::vector<float> lengths(result.n_cv), areas(result.n_cv), electrotonic(result.n_cv);
+  for (auto cv = 0ul; cv < result.n_cv; ++cv) {
+    auto length = 0.0, area = 0.0;
+    // Ra weighted by length, Cm by area; the defaults cover what no region claims
+    auto ra_sum = 0.0, ra_len = 0.0, cm_sum = 0.0, cm_area = 0.0;
+    for (const auto& cable: data.cables(cv)) {
+      length += embedding.integrate_length(cable);
+      area   += embedding.integrate_area(cable);
+      for (const auto& [cables, rg]: painted) {
+        for (const auto& c: cables) {
+          if (c.branch != cable.branch) continue;
+          auto lo = std::max(c.prox_pos, cable.prox_pos), hi = std::min(c.dist_pos, cable.dist_pos);
+          if (lo >= hi) continue;
+          auto part = arb::mcable{cable.branch, lo, hi};
+          if (rg->Ra) {
+            auto l = embedding.integrate_length(part);
+            ra_sum += l*rg->Ra.value(); ra_len += l;
+          }
+          if (rg->Cm) {
+            auto a = embedding.integrate_area(part);
+            cm_sum += a*rg->Cm.value(); cm_area += a;
+          }
+        }
+      }
+    }
+    auto ra = length > 0 ? (ra_sum + std::max(length - ra_len, 0.0)*Ra)/length : Ra;
+    auto cm = area   > 0 ? (cm_sum + std::max(area - cm_area, 0.0)*Cm)/area   : Cm;
+    // Diameter of a cylinder with the same length and area; then
+    // lambda_f = 1/2 sqrt(d/(pi f Ra Cm)), converted to um.
+    auto diameter = length > 0 ? area/(std::numbers::pi*length) : 0.0;
+    auto lambda   = 0.5e4*std::sqrt(diameter/(std::numbers::pi*f_lambda*ra*cm));
+    lengths[cv]      = length;
+    areas[cv]        = area;
+    electrotonic[cv] = lambda > 0 ? length/lambda : 0.0;
+  }
+
+  auto range = [](const auto& xs) -> std::pair<float, float> {
+    if (xs.empty()) return {0.0f, 0.0f};
+    auto [lo, hi] = std::minmax_element(xs.begin(), xs.end());
+    return {*lo, *hi};
+  };
+  auto histogram = [](const auto& xs, const auto& range) {
+    std::vector<float> bins(n_bins, 0.0f);
+    auto [lo, hi] = range;
+    auto scale = hi > lo ? n_bins/(hi - lo) : 0.0f;
+    for (const auto& x: xs) bins[std::min<size_t>((x - lo)*scale, n_bins - 1)] += 1.0f;
+    return bins;
+  };
+  result.length           = range(lengths);
+  result.area             = range(areas);
+  result.electrotonic     = range(electrotonic);
+  result.length_histogram = histogram(lengths, result.length);
+  result.area_histogram   = histogram(areas, result.area);
+  log_debug("Discretised into {} CVs", result.n_cv);
+  return result;
+}
+
+// Named lookups hit the labels the provider concretised while being built,
+// so the parallel part is mapping extents onto segments and markers.
+std::vector<std::vector<arb::msegment>> cell_builder::make_segments(const std::vector<rg_def*>& defs) {
+  std::vector<std::vector<arb::msegment>> result(defs.size());
+  parallel_for(defs.size(), [&](size_t ix) {
+    auto& def = *defs[ix];
+    if (def.state != def_state::good) return;
+    try {
+      result[ix] = make_segments(arb::reg::named(def.name));
+    } catch (const arb::arbor_exception& e) {
+      def.set_error(e.what());
+    }
+  });
+  return result;
+}
+
+std::vector<std::vector<glm::vec3>> cell_builder::make_points(const std::vector<ls_def*>& defs) {
+  std::vector<std::vector<glm::vec3>> result(defs.size());
+  parallel_for(defs.size(), [&](size_t ix) {
+    auto& def = *defs[ix];
+    if (def.state != def_state::good) return;
+    try {
+      result[ix] = make_points(arb::ls::named(def.name));
+    } catch (const arb::arbor_exception& e) {
+      def.set_error(e.what());
+    }
+  });
+  return result;
+}
+
+// One at a time; each `make_iexpr` already spreads its segments over all cores.
+void cell_builder::make_iexprs(const std::vector<ie_def*>& defs) {
+  for (auto* def: defs) {
+    if (def->state != def_state::good) continue;
+    try {
+      def->info = make_iexpr(arb::iexpr::named(def->name));
+    } catch (const arb::arbor_exception& e) {
+      def->set_error(e.what());
+    }
+  }
 }
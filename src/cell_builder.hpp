@@ -1,7 +1,12 @@
 #pragma once
 
+#include <memory>
+#include <optional>
+#include <string>
 #include <vector>
+#include <variant>
 #include <unordered_map>
+#include <unordered_set>
 
 #include <arbor/cable_cell.hpp>
 #include <arbor/morph/place_pwlin.hpp>
@@ -12,23 +17,85 @@
 
 #include <glm/glm.hpp>
 
+#include "id.hpp"
 #include "location.hpp"
 
+enum class label_kind { region, locset, iexpr };
+using label_key = std::pair<label_kind, std::string>;
+
+// Labels referenced as (region "x"), (locset "x"), or (iexpr "x") in a definition.
+std::vector<label_key> label_references(const std::string& definition);
+
+// Concretised label and the definition it was computed from.
+struct label_memo {
+    std::string definition;
+    std::variant<arb::region, arb::locset, arb::iexpr> value;
+};
+
+// Position of a segment's ends along its branch.
+struct segment_span {
+    arb::msize_t branch;
+    unsigned id;
+    double prox, dist;
+};
+
+// Discretisation of the cell under a CV policy, with statistics to judge its cost.
+struct cv_discretisation {
+    std::string error = "";                 // Set if the policy could not be applied
+    std::vector<glm::vec3> boundaries;
+    size_t n_cv = 0;
+    // Ranges over CVs of length (um), area (um^2), and electrotonic length,
+    // ie length over the AC length constant at 100Hz.
+    std::pair<float, float> length       = {0.0f, 0.0f};
+    std::pair<float, float> area         = {0.0f, 0.0f};
+    std::pair<float, float> electrotonic = {0.0f, 0.0f};
+    std::vector<float> length_histogram, area_histogram;
+};
+
+// Axial resistivity and membrane capacitance painted on a region, overriding the defaults.
+struct cv_parameters {
+    arb::region region;
+    std::optional<double> Ra, Cm;
+};
+
 struct cell_builder {
     arb::morphology  morph;
     arb::place_pwlin pwlin;
-    arb::label_dict  labels;
+    arb::label_dict  labels;    // Expressions as defined, used for building cells
+    arb::label_dict  concrete;  // Memoised extents and locations backing `provider`
     arb::mprovider   provider;
+    std::unordered_map<label_key, std::shared_ptr<const label_memo>> memos;
     arb::cv_policy   policy = arb::default_cv_policy();
+    size_t           label_version = 0;     // Bumped whenever `labels` changes
+    bool             stale_labels  = false; // `labels`, `concrete`, and `provider` await `make_label_dict`
 
     cell_builder();
     cell_builder(const arb::morphology& t);
 
+    // Copy for evaluating labels off the render thread: shares morphology and
+    // memos, and leaves the dictionaries for `make_label_dict` to rebuild.
+    cell_builder label_worker() const;
+
     std::vector<arb::msegment> make_segments(const arb::region&);
     std::vector<glm::vec3>     make_points(const arb::locset&);
-    std::vector<glm::vec3>     make_boundary(const arb::cv_policy&);
+    // Axial resistivity `Ra` in Ohm cm, membrane capacitance `Cm` in F/m^2; `regions`
+    // override them where painted, averaged over each CV by length and area.
+    cv_discretisation          make_discretisation(const arb::cv_policy&, double Ra, double Cm,
+                                                   const std::vector<cv_parameters>& regions = {});
     iexpr_info                 make_iexpr(const arb::iexpr&);
-    void                       make_label_dict(std::vector<ls_def>& locsets,
-                                               std::vector<rg_def>& regions,
-                                               std::vector<ie_def>& iexprs);
+    std::vector<segment_span>  segment_spans() const;
+    // For each segment id, the indices of the cables in `cables` covering its proximal
+    // and distal ends; `cables.size()` where there is none.
+    std::vector<std::pair<unsigned, unsigned>> make_cable_map(const arb::mcable_list& cables) const;
+    // Batched versions for labels already in the dictionary; these run in
+    // parallel, record failures on the definition and leave its result empty.
+    std::vector<std::vector<arb::msegment>> make_segments(const std::vector<rg_def*>&);
+    std::vector<std::vector<glm::vec3>>     make_points(const std::vector<ls_def*>&);
+    void                                    make_iexprs(const std::vector<ie_def*>&);
+
+    // Re-evaluate changed labels and their dependents only; returns the labels
+    // that were re-evaluated, successful or not.
+    std::unordered_set<label_key> make_label_dict(std::vector<ls_def>& locsets,
+                                                  std::vector<rg_def>& regions,
+                                                  std::vector<ie_def>& iexprs);
 };
@@ -3,82 +3,133 @@
 #include "id.hpp"
 #include "utils.hpp"
 
+// Storage is based on sparse sets: `sparse` maps an id's slot (`id.value`) to
+// the index into the dense `items`, so lookup, insertion and removal are O(1)
+// and iteration over `items` is contiguous. Slots are recycled; the id's
+// generation tells a live id from a stale handle to a recycled slot. Stale ids
+// are only diagnosed in debug builds.
+
+constexpr size_t no_index = -1;
+
+// Hands out ids and recycles the slots of deleted ones.
+struct id_pool {
+    std::vector<size_t> generations; // Current generation per slot
+    std::vector<size_t> free;        // Released slots
+
+    id_type acquire() {
+        if (free.empty()) {
+            generations.push_back(0);
+            return {generations.size() - 1, 0};
+        }
+        auto slot = free.back();
+        free.pop_back();
+        return {slot, generations[slot]};
+    }
+
+    void release(const id_type& id) {
+        ++generations[id.value];
+        free.push_back(id.value);
+    }
+
+    bool alive(const id_type& id) const { return id.value < generations.size() && generations[id.value] == id.generation; }
+};
+
 struct entity {
-    std::vector<id_type> ids;
+    std::vector<id_type> ids; // Live ids in display order
+    id_pool pool;
 
     id_type add() {
-        id_type result{id++};
+        auto result = pool.acquire();
         ids.push_back(result);
         return result;
     }
     void del(const id_type& id) {
         std::erase_if(ids, [&] (const auto& it){ return id == it; });
+        pool.release(id);
     }
 
-    size_t id = 0;
-
     auto begin() { return ids.begin(); }
     auto end()   { return ids.end(); }
     auto begin() const { return ids.begin(); }
     auto end()   const { return ids.end(); }
-    auto clear() { ids.clear(); }
+    auto clear() {
+        for (const auto& id: ids) pool.release(id);
+        ids.clear();
+    }
 };
 
 template<typename C>
 struct component_unique {
     std::vector<C> items;                           // List of items
-    std::unordered_map<id_type, size_t> parents;    // Given the parent ID, get back the ID
-    std::vector<id_type> idx_to_parent;             // Given the ID, get back the parent ID
+    std::vector<id_type> idx_to_parent;             // Given the index, get back the parent ID
+    std::vector<size_t> sparse;                     // Given the parent slot, get the index
 
-    auto clear() { items.clear(); parents.clear(); idx_to_parent.clear();}
+    auto clear() { items.clear(); idx_to_parent.clear(); sparse.clear(); }
+
+    bool contains(const id_type& parent) const {
+        return parent.value < sparse.size()
+            && sparse[parent.value] != no_index
+            && idx_to_parent[sparse[parent.value]] == parent;
+    }
 
     void add(const id_type& parent, const C& c={}) {
-        auto idx = items.size();
+        check_free(parent);
+        if (parent.value >= sparse.size()) sparse.resize(parent.value + 1, no_index);
+        sparse[parent.value] = items.size();
         items.push_back(c);
-        parents[parent] = idx;
         idx_to_parent.push_back(parent);
-        check();
     }
 
     C& operator[](const id_type& parent) {
-        return items[parents[parent]];
+        check(parent);
+        return items[sparse[parent.value]];
+    }
+
+    const C& operator[](const id_type& parent) const {
+        check(parent);
+        return items[sparse[parent.value]];
     }
 
     void del(const id_type& id) {
-        auto idx = parents[id];
+        check(id);
+        auto idx = sparse[id.value];
         auto end = items.size() - 1;
         auto old = idx_to_parent[end];
-        log_debug("[CU] Deleting {}: {} -> {}", id.value, parents[id], idx_to_parent[parents[id]].value);
+        log_debug("[CU] Deleting {}: {} -> {}", id.value, idx, old.value);
         std::swap(items[idx], items[end]);
         std::swap(idx_to_parent[idx], idx_to_parent[end]);
         items.pop_back();
         idx_to_parent.pop_back();
-        parents[old] = idx;
-        parents.erase(id);
-        check();
+        sparse[old.value] = idx;
+        sparse[id.value]  = no_index;
     }
 
-    void check() {
-        if(items.size() != parents.size()) log_error("Size mismatch parents {} ./. {}", items.size(), parents.size());
-        if(items.size() != idx_to_parent.size()) log_error("Size mismatch indices {} ./. {}", items.size(), idx_to_parent.size());
-        for (auto idx = 0; idx < items.size(); ++idx) {
-            if(parents[idx_to_parent[idx]] != idx) log_error("Round trip broken {}", idx);
-        }
+#ifndef NDEBUG
+    void check(const id_type& id) const {
+        if (!contains(id)) log_error("[CU] Unknown or stale id {}/{}", id.value, id.generation);
+    }
+    void check_free(const id_type& id) const {
+        if (id.value < sparse.size() && sparse[id.value] != no_index) log_error("[CU] Slot {} already taken", id.value);
     }
+#else
+    void check(const id_type&) const {}
+    void check_free(const id_type&) const {}
+#endif
 };
 
 template<typename C>
 struct component_many {
     std::vector<C> items;
-    std::vector<id_type> ids;
     std::vector<id_type> idx_to_parent;
     std::vector<id_type> idx_to_id;
-    std::unordered_map<id_type, size_t> lookup;
-    std::unordered_map<id_type, std::vector<id_type>> parents;
+    std::vector<size_t> sparse;                     // Given the child slot, get the index
+    std::vector<std::vector<id_type>> parents;      // Given the parent slot, get the children
+    id_pool pool;
 
-    size_t id = 0;
-
-    auto clear() { items.clear(); parents.clear(); idx_to_parent.clear(); idx_to_id.clear(); lookup.clear(); ids.clear(); }
+    auto clear() {
+        for (const auto& id: idx_to_id) pool.release(id);
+        items.clear(); parents.clear(); idx_to_parent.clear(); idx_to_id.clear(); sparse.clear();
+    }
 
     struct child_iter {
         std::vector<id_type>::iterator beg_, cur_, end_;
@@ -88,14 +139,25 @@ struct component_many {
         auto end()  { return end_;}
     };
 
-    auto& operator[](const id_type& ref) { return items[lookup[ref]]; }
+    bool contains(const id_type& id) const {
+        return pool.alive(id) && id.value < sparse.size() && sparse[id.value] != no_index;
+    }
 
-    id_type add(const id_type& parent, const C& c={}) {
-        id_type result{id++};
-        auto idx = items.size();
+    auto& operator[](const id_type& ref) {
+        check(ref);
+        return items[sparse[ref.value]];
+    }
+
+    const auto& operator[](const id_type& ref) const {
+        check(ref);
+        return items[sparse[ref.value]];
+    }
 
-        lookup[result] = idx;
-        parents[parent].push_back(result);
+    id_type add(const id_type& parent, const C& c={}) {
+        auto result = pool.acquire();
+        if (result.value >= sparse.size()) sparse.resize(result.value + 1, no_index);
+        sparse[result.value] = items.size();
+        children(parent).push_back(result);
         idx_to_parent.push_back(parent);
         idx_to_id.push_back(result);
         items.push_back(c);
@@ -103,85 +165,130 @@ struct component_many {
     }
 
     auto get_children(const id_type& parent) {
-        auto& chunk = parents[parent];
+        auto& chunk = children(parent);
         return child_iter{.beg_=chunk.begin(),
                           .cur_=chunk.begin(),
                           .end_=chunk.end()};
     }
 
     void del(const id_type& id) {
+        check(id);
         // Find indices and swap/delete
-        auto idx = lookup[id];
+        auto idx = sparse[id.value];
         auto end = items.size() - 1;
         std::swap(items[idx], items[end]);
         items.pop_back();
 
         // Remove delete element from parent -> children
         auto parent = idx_to_parent[idx];
-        std::erase_if(parents[parent], [&] (const auto& it) { return it == id; });
+        std::erase_if(children(parent), [&] (const auto& it) { return it == id; });
 
         // Update mappings
-        idx_to_id[idx]         = idx_to_id[end];
-        idx_to_parent[idx]     = idx_to_parent[end];
-        lookup[idx_to_id[end]] = idx;
+        idx_to_id[idx]              = idx_to_id[end];
+        idx_to_parent[idx]          = idx_to_parent[end];
+        sparse[idx_to_id[idx].value] = idx;
+        sparse[id.value]            = no_index;
 
         // Shave off remainder
         idx_to_id.pop_back();
         idx_to_parent.pop_back();
-        lookup.erase(id);
+        pool.release(id);
     }
 
     void del_children(const id_type& id) {
-        std::vector<id_type> to_remove;
-        for (const auto& child: get_children(id)) to_remove.push_back(child);
+        auto to_remove = children(id);
         for (const auto& key: to_remove) del(key);
     }
+
+private:
+    std::vector<id_type>& children(const id_type& parent) {
+        if (parent.value >= parents.size()) parents.resize(parent.value + 1);
+        return parents[parent.value];
+    }
+
+#ifndef NDEBUG
+    void check(const id_type& id) const {
+        if (!contains(id)) log_error("[CM] Unknown or stale id {}/{}", id.value, id.generation);
+    }
+#else
+    void check(const id_type&) const {}
+#endif
 };
 
+// Items keyed by a pair of ids; `sparse` is a table over both slots, so
+// deleting all items for one side costs O(1) per item visited in its row/column.
 template<typename C>
 struct component_join {
     using key_type = std::pair<id_type, id_type>;
     std::vector<C> items;
     std::vector<key_type> idx_to_parent;
-    std::unordered_map<key_type, size_t> parents;
+    std::vector<std::vector<size_t>> sparse;        // Given the slots (first, second), get the index
+    size_t n_second = 0;                            // Width of the table
 
-    auto& operator[](const key_type& key) { return items[parents[key]]; }
+    bool contains(const key_type& key) const {
+        const auto& [a, b] = key;
+        return a.value < sparse.size()
+            && b.value < sparse[a.value].size()
+            && sparse[a.value][b.value] != no_index
+            && idx_to_parent[sparse[a.value][b.value]] == key;
+    }
+
+    auto& operator[](const key_type& key) {
+        check(key);
+        return items[sparse[key.first.value][key.second.value]];
+    }
+
+    const auto& operator[](const key_type& key) const {
+        check(key);
+        return items[sparse[key.first.value][key.second.value]];
+    }
 
     void add(const id_type& a, const id_type& b, const C& c= {}) {
-        auto idx = items.size();
-        auto par = std::make_pair(a, b);
-        parents[par] = idx;
-        idx_to_parent.push_back(par);
+        n_second = std::max(n_second, b.value + 1);
+        if (a.value >= sparse.size()) sparse.resize(a.value + 1);
+        auto& row = sparse[a.value];
+        if (row.size() < n_second) row.resize(n_second, no_index);
+        row[b.value] = items.size();
+        idx_to_parent.push_back({a, b});
         items.push_back(c);
     }
 
     void del(const key_type& id) {
-        auto idx = parents[id];
+        check(id);
+        auto idx = sparse[id.first.value][id.second.value];
         auto end = items.size() - 1;
         auto old = idx_to_parent[end];
         std::swap(items[idx], items[end]);
         std::swap(idx_to_parent[idx], idx_to_parent[end]);
         items.pop_back();
         idx_to_parent.pop_back();
-        parents[old] = idx;
-        parents.erase(id);
+        sparse[old.first.value][old.second.value] = idx;
+        sparse[id.first.value][id.second.value]   = no_index;
     }
 
     void del_by_1st(const id_type& id) {
-        std::vector<key_type> to_remove;
-        for (const auto& [key, val]: parents) {
-            if (key.first == id) to_remove.push_back(key);
+        if (id.value >= sparse.size()) return;
+        for (auto& idx: sparse[id.value]) {
+            if (idx != no_index && idx_to_parent[idx].first == id) del(key_type{idx_to_parent[idx]});
         }
-        for (const auto& key: to_remove) del(key);
     }
 
     void del_by_2nd(const id_type& id) {
-        std::vector<key_type> to_remove;
-        for (const auto& [key, val]: parents) {
-            if (key.second == id) to_remove.push_back(key);
+        for (auto& row: sparse) {
+            if (id.value >= row.size()) continue;
+            auto idx = row[id.value];
+            if (idx != no_index && idx_to_parent[idx].second == id) del(key_type{idx_to_parent[idx]});
         }
-        for (const auto& key: to_remove) del(key);
     }
 
-    auto clear() { items.clear(); parents.clear(); idx_to_parent.clear();}
+    auto clear() { items.clear(); idx_to_parent.clear(); sparse.clear(); n_second = 0; }
+
+private:
+#ifndef NDEBUG
+    void check(const key_type& key) const {
+        if (!contains(key)) log_error("[CJ] Unknown or stale id {}/{}", key.first.value, key.second.value);
+    }
+#else
+    void check(const key_type&) const {}
+#endif
 };
@@ -2,6 +2,8 @@
 
 #include "gui.hpp"
 
+#include <cfloat>
+
 #include <arborio/cv_policy_parse.hpp>
 
 void cv_def::set_error(const std::string& m) {
@@ -31,7 +33,7 @@ void cv_def::update() {
     }
 }
 
-void gui_cv_policy(cv_def& item, renderable& render, event_queue& evts) {
+void gui_cv_policy(cv_def& item, renderable& render, event_queue& evts, const cv_discretisation* cvs) {
     auto  open   = gui_tree("CV policy");
     ImGui::SameLine();
     ImGui::ColorEdit3("##cv-bounds-color", &render.color.x, ImGuiColorEditFlags_NoInputs | ImGuiColorEditFlags_NoLabel);
@@ -52,6 +54,19 @@ void gui_cv_policy(cv_def& item, renderable& render, event_queue& evts) {
         ImGui::PushTextWrapPos(ImGui::GetFontSize() * 50.0f);
         if (ImGui::InputTextMultiline("##cv-definition", &item.definition)) evts.push_back(evt_upd_cv{});
         ImGui::PopTextWrapPos();
+        if (!cvs) {
+            ImGui::TextDisabled("Discretising...");
+        } else if (cvs->error.empty()) {
+            ImGui::Text("%zu CVs", cvs->n_cv);
+            ImGui::Text("Electrotonic length %.3g - %.3g", cvs->electrotonic.first, cvs->electrotonic.second);
+            gui_tooltip("CV length over the AC length constant at 100Hz; keep below ~0.1.");
+            ImGui::PlotHistogram("##cv-length", cvs->length_histogram.data(), int(cvs->length_histogram.size()), 0,
+                                 frame_format("Length {:.3g} - {:.3g} um", cvs->length.first, cvs->length.second),
+                                 0.0f, FLT_MAX, {0, 40});
+            ImGui::PlotHistogram("##cv-area", cvs->area_histogram.data(), int(cvs->area_histogram.size()), 0,
+                                 frame_format("Area {:.3g} - {:.3g} um^2", cvs->area.first, cvs->area.second),
+                                 0.0f, FLT_MAX, {0, 40});
+        }
         ImGui::TreePop();
     }
 }
@@ -24,4 +24,5 @@ struct cv_def {
     void update();
 };
 
-void gui_cv_policy(cv_def& item, renderable& render, event_queue& evts);
+// `cvs` is the matching discretisation, if already made.
+void gui_cv_policy(cv_def& item, renderable& render, event_queue& evts, const cv_discretisation* cvs);
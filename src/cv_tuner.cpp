@@ -0,0 +1,149 @@
+#include "cv_tuner.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <tuple>
+
+#include <fmt/format.h>
+#include <implot.h>
+
+#include "cv_policy.hpp"
+#include "gui.hpp"
+#include "icons.hpp"
+
+std::vector<double> cv_tuner::extents() const {
+    std::vector<double> result;
+    auto n = std::max(steps, 2);
+    auto q = std::pow(finest/coarsest, 1.0/(n - 1));
+    for (auto ix = 0; ix < n; ++ix) result.push_back(coarsest*std::pow(q, ix));
+    return result;
+}
+
+std::optional<size_t> cv_tuner::recommended() const {
+    for (auto ix = 0ul; ix < candidates.size(); ++ix) {
+        if (candidates[ix].error <= tolerance) return ix;
+    }
+    return {};
+}
+
+namespace {
+    // Largest deviation of `run` from `ref` over all probes, relative to the range of `ref`.
+    // Series are matched by (tag, index); both lists are sorted that way.
+    double compare(const model_run& run, const model_run& ref) {
+        auto result = 0.0;
+        auto key = [](const probe_series& s) { return std::tie(s.tag, s.index); };
+        auto it = run.series.begin();
+        for (const auto& y: ref.series) {
+            while (it != run.series.end() && key(*it) < key(y)) ++it;
+            if (it == run.series.end()) break;
+            if (key(*it) != key(y)) continue;
+            const auto& xs = it->values;
+            const auto& ys = y.values;
+            if (ys.empty()) continue;
+            auto [lo, hi] = std::minmax_element(ys.begin(), ys.end());
+            auto range = *hi - *lo;
+            auto err = 0.0;
+            for (auto jx = 0ul; jx < std::min(xs.size(), ys.size()); ++jx) err = std::max<double>(err, std::abs(xs[jx] - ys[jx]));
+            result = std::max(result, range > 0 ? err/range : err);
+        }
+        return result;
+    }
+}
+
+std::vector<cv_candidate> tune_cv_policy(const model& base, double until, double dt,
+                                         const std::vector<double>& extents,
+                                         task_progress& progress) {
+    progress.enter(0);
+    std::vector<cv_candidate> result(extents.size());
+    std::vector<model_run> runs(extents.size());
+    std::atomic<size_t> done = 0;
+    parallel_for(extents.size(), [&](size_t ix) {
+        progress.check();
+        auto& candidate = result[ix];
+        candidate.policy = fmt::format("(max-extent {:.3g})", extents[ix]);
+        cv_def policy{candidate.policy};
+        if (policy.state != def_state::good) log_error("Cannot parse policy '{}': {}", candidate.policy, policy.message);
+        auto mdl = base;
+        mdl.decor.set_default(policy.data.value());
+        runs[ix] = run_model(mdl, until, dt, progress);
+        candidate.runtime = runs[ix].runtime;
+        progress.advance(++done, extents.size());
+    });
+    for (auto ix = 0ul; ix < runs.size(); ++ix) result[ix].error = compare(runs[ix], runs.back());
+    return result;
+}
+
+void poll_cv_tuner(cv_tuner& tuner) {
+    if (!tuner.running || !tuner.running->ready()) return;
+    auto done = std::move(tuner.running.value());
+    tuner.running.reset();
+    try {
+        tuner.candidates = done.get();
+        tuner.error.clear();
+    } catch (const task_cancelled&) {
+    } catch (const std::exception& e) {
+        log_warn("CV tuning failed: {}", e.what());
+        tuner.error = e.what();
+    }
+}
+
+void gui_cv_tuner(cv_tuner& tuner) {
+    if (!gui_tree("CV tuner")) return;
+    {
+        with_item_width width(120.0f);
+        gui_input_double("Coarsest extent", tuner.coarsest, "um");
+        gui_input_double("Finest extent",   tuner.finest,   "um");
+        ImGui::InputInt("Steps", &tuner.steps);
+        tuner.steps = std::clamp(tuner.steps, 2, 32);
+        auto percent = 100*tuner.tolerance;
+        if (gui_input_double("Tolerance", percent, "%")) tuner.tolerance = std::max(0.0, percent/100);
+    }
+    if (tuner.running) {
+        auto& progress = tuner.running->progress();
+        ImGui::ProgressBar(progress.total(), {-40.0f, 0.0f}, progress.label().c_str());
+        ImGui::SameLine();
+        if (ImGui::Button(icon_delete)) tuner.running->cancel();
+    } else {
+        tuner.should_run = ImGui::Button(frame_format("{} Tune", icon_start));
+        gui_tooltip("Simulate at each extent, in parallel, and compare probes to the finest. "
+                    "Runtimes are measured side by side, so compare them with each other only.");
+    }
+    if (!tuner.error.empty()) ImGui::TextWrapped("%s %s", icon_error, tuner.error.c_str());
+
+    if (!tuner.candidates.empty()) {
+        auto best = tuner.recommended();
+        if (ImGui::BeginTable("##cv-candidates", 4, ImGuiTableFlags_RowBg)) {
+            ImGui::TableSetupColumn("Policy");
+            ImGui::TableSetupColumn("Runtime (loaded)");
+            ImGui::TableSetupColumn("Error");
+            ImGui::TableSetupColumn("");
+            ImGui::TableHeadersRow();
+            for (auto ix = 0ul; ix < tuner.candidates.size(); ++ix) {
+                const auto& candidate = tuner.candidates[ix];
+                with_id id{ix};
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("%s %s", best == ix ? icon_ok : " ", candidate.policy.c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f ms", 1e3*candidate.runtime);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3g %%", 100*candidate.error);
+                ImGui::TableNextColumn();
+                if (ImGui::SmallButton("Use")) tuner.apply = candidate.policy;
+            }
+            ImGui::EndTable();
+        }
+        if (ImPlot::BeginPlot("##cv-tradeoff", {-1, 160})) {
+            ImPlot::SetupAxes("Runtime (t/ms)", "Error (%)");
+            std::vector<double> xs, ys;
+            for (const auto& candidate: tuner.candidates) {
+                xs.push_back(1e3*candidate.runtime);
+                ys.push_back(100*candidate.error);
+            }
+            ImPlot::PlotScatter("Candidates", xs.data(), ys.data(), xs.size());
+            ImPlot::EndPlot();
+        }
+    }
+    ImGui::TreePop();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "simulation.hpp"
+#include "task.hpp"
+
+struct cv_candidate {
+    std::string policy;
+    double runtime = 0.0;  // [s], while the other candidates run alongside
+    double error   = 0.0;  // Largest deviation from the finest candidate, relative to its range
+};
+
+// Runs the model at a ladder of `(max-extent L)` policies and compares the
+// probe traces against the finest one.
+struct cv_tuner {
+    double coarsest  = 100.0; // [um]
+    double finest    = 1.0;   // [um]
+    int    steps     = 7;
+    double tolerance = 0.01;
+
+    bool should_run = false;
+    std::optional<std::string> apply;  // Policy picked by the user
+
+    std::optional<task<std::vector<cv_candidate>>> running;
+    std::vector<cv_candidate> candidates; // Coarse to fine; the last is the reference
+    std::string error;
+
+    std::vector<double> extents() const;
+    // Coarsest candidate within tolerance
+    std::optional<size_t> recommended() const;
+};
+
+// Runs one model per extent in parallel, each replacing the policy of `base`.
+std::vector<cv_candidate> tune_cv_policy(const model& base, double until, double dt,
+                                         const std::vector<double>& extents,
+                                         task_progress& progress);
+
+void poll_cv_tuner(cv_tuner&);
+void gui_cv_tuner(cv_tuner&);
@@ -0,0 +1,255 @@
+#include "ensemble.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <fmt/format.h>
+#include <imgui.h>
+#include <implot.h>
+
+#include "gui.hpp"
+#include "icons.hpp"
+
+namespace {
+    // Marker probabilities: 0, then each percentile with the midpoints either side, then 1.
+    constexpr auto marker_probabilities = [] {
+        std::array<double, quantile_estimator::markers> result = {};
+        auto n = ensemble_percentiles.size();
+        for (auto ix = 0ul; ix < n; ++ix) {
+            auto below = ix ? ensemble_percentiles[ix - 1] : 0.0;
+            result[2*ix + 1] = 0.5*(below + ensemble_percentiles[ix]);
+            result[2*ix + 2] = ensemble_percentiles[ix];
+        }
+        result[2*n + 1] = 0.5*(ensemble_percentiles[n - 1] + 1.0);
+        result[2*n + 2] = 1.0;
+        return result;
+    }();
+}
+
+void quantile_estimator::add(size_t ix, float time, float value) {
+    constexpr auto M = markers;
+    if (ix >= samples.size()) {
+        samples.resize(ix + 1);
+        times.resize(ix + 1);
+    }
+    times[ix] = time;
+    auto& s = samples[ix];
+    auto& h = s.heights;
+    auto& n = s.positions;
+    // Collect the first M observations as they are
+    if (s.count < M) {
+        h[s.count++] = value;
+        if (s.count == M) {
+            std::sort(h.begin(), h.end());
+            for (auto jx = 0ul; jx < M; ++jx) n[jx] = jx + 1;
+        }
+        return;
+    }
+    size_t k = 0;
+    if (value < h[0]) {
+        h[0] = value;
+    } else if (value >= h[M - 1]) {
+        h[M - 1] = value;
+        k = M - 2;
+    } else {
+        k = std::upper_bound(h.begin(), h.end(), value) - h.begin() - 1;
+    }
+    for (auto jx = k + 1; jx < M; ++jx) ++n[jx];
+    ++s.count;
+    // Nudge inner markers towards their desired positions, parabolic where that stays monotone
+    for (auto jx = 1ul; jx < M - 1; ++jx) {
+        auto d  = 1.0 + (s.count - 1)*marker_probabilities[jx] - n[jx];
+        auto up = double(n[jx + 1]) - n[jx], down = double(n[jx - 1]) - n[jx];
+        if (!((d >= 1 && up > 1) || (d <= -1 && down < -1))) continue;
+        auto sign = d > 0 ? 1 : -1;
+        auto span = double(n[jx + 1]) - n[jx - 1];
+        auto hp = h[jx] + sign/span*((n[jx] - double(n[jx - 1]) + sign)*(h[jx + 1] - h[jx])/up
+                                   + (n[jx + 1] - double(n[jx]) - sign)*(h[jx] - h[jx - 1])/-down);
+        if (h[jx - 1] < hp && hp < h[jx + 1]) {
+            h[jx] = hp;
+        } else {
+            auto other = jx + sign;
+            h[jx] += sign*(h[other] - h[jx])/(double(n[other]) - n[jx]);
+        }
+        n[jx] += sign;
+    }
+}
+
+float quantile_estimator::quantile(size_t ix, size_t q) const {
+    const auto& s = samples.at(ix);
+    if (!s.count) return 0.0f;
+    if (s.count >= markers) return s.heights[2*q + 2];
+    // Too few for the markers; take the nearest rank
+    auto h = s.heights;
+    std::sort(h.begin(), h.begin() + s.count);
+    auto rank = size_t(std::lround(ensemble_percentiles[q]*(s.count - 1)));
+    return h[rank];
+}
+
+double draw(const ensemble_parameter& p, std::mt19937& rng) {
+    if (p.distribution == "Normal") return std::normal_distribution<double>{p.a, std::abs(p.b)}(rng);
+    if (p.distribution == "Log-normal") return p.a*std::exp(std::normal_distribution<double>{0.0, std::abs(p.b)}(rng));
+    return std::uniform_real_distribution<double>{std::min(p.a, p.b), std::max(p.a, p.b)}(rng);
+}
+
+std::map<std::string, percentile_band> run_ensemble(const model& base, const variant_decor_fn& decor,
+                                                    const std::vector<ensemble_parameter>& parameters,
+                                                    size_t size, size_t batch, unsigned seed,
+                                                    double until, double dt, task_progress& progress) {
+    std::map<std::string, quantile_estimator> estimators;
+    std::mt19937 rng{seed};
+    for (auto lo = 0ul, stage = 0ul; lo < size; lo += batch, ++stage) {
+        progress.enter(stage);
+        // Only the decor differs; the rest is taken from the first cell.
+        std::vector<model> cells;
+        for (auto ix = lo; ix < std::min(lo + batch, size); ++ix) {
+            progress.check();
+            std::vector<double> values;
+            for (const auto& p: parameters) values.push_back(draw(p, rng));
+            auto& cell = cells.empty() ? cells.emplace_back(base) : cells.emplace_back();
+            cell.decor = decor(values);
+        }
+        // Kept per cell while running, folded in afterwards; no locking.
+        for (const auto& run: run_batch(cells, until, dt, progress)) {
+            for (const auto& s: run.series) {
+                // Point probes only; cable samples have several values per time.
+                if (s.times.size() != s.values.size()) continue;
+                auto& estimator = estimators[fmt::format("{}/{}", s.tag, s.index)];
+                for (auto ix = 0ul; ix < s.times.size(); ++ix) estimator.add(ix, s.times[ix], s.values[ix]);
+            }
+        }
+    }
+    std::map<std::string, percentile_band> result;
+    for (const auto& [key, estimator]: estimators) {
+        auto& band = result[key];
+        auto n = estimator.samples.size();
+        band.times = estimator.times;
+        band.runs  = size;
+        for (auto q = 0ul; q < ensemble_percentiles.size(); ++q) {
+            band.values[q].resize(n);
+            for (auto ix = 0ul; ix < n; ++ix) band.values[q][ix] = estimator.quantile(ix, q);
+        }
+        for (const auto& s: estimator.samples) band.runs = std::min<size_t>(band.runs, s.count);
+    }
+    return result;
+}
+
+void poll_ensemble(ensemble& ens) {
+    if (!ens.running || !ens.running->ready()) return;
+    auto done = std::move(ens.running.value());
+    ens.running.reset();
+    try {
+        ens.bands = done.get();
+        ens.error.clear();
+    } catch (const task_cancelled&) {
+    } catch (const std::exception& e) {
+        log_warn("Ensemble run failed: {}", e.what());
+        ens.error = e.what();
+    }
+}
+
+namespace {
+    std::pair<const char*, const char*> parameter_labels(const std::string& distribution) {
+        if (distribution == "Normal")     return {"Mean", "SD"};
+        if (distribution == "Log-normal") return {"Median", "Sigma"};
+        return {"Low", "High"};
+    }
+
+    void defaults(ensemble_parameter& p, double current) {
+        if (p.distribution == "Normal")     { p.a = current; p.b = 0.1*std::abs(current); }
+        if (p.distribution == "Log-normal") { p.a = current; p.b = 0.1; }
+        if (p.distribution == "Uniform")    { p.a = 0.9*current; p.b = 1.1*current; }
+    }
+}
+
+void gui_ensemble(ensemble& ens, const model_values_fn& available) {
+    if (!gui_tree("Ensemble")) return;
+    auto busy = ens.running.has_value();
+    {
+        with_item_width width(120.0f);
+        ImGui::InputInt("Variants", &ens.size);
+        ens.size = std::max(ens.size, 1);
+        ImGui::InputInt("Cells per batch", &ens.batch);
+        ens.batch = std::max(ens.batch, 1);
+        gui_tooltip("Variants simulated at once; bounds memory for large ensembles.");
+        auto seed = int(ens.seed);
+        if (ImGui::InputInt("Seed", &seed)) ens.seed = unsigned(seed);
+        if (!busy && ImGui::BeginCombo("##add-ensemble-parameter", frame_format("{} Parameter", icon_add))) {
+            for (const auto& [value, current]: available()) {
+                auto known = std::any_of(ens.parameters.begin(), ens.parameters.end(), [&](const auto& p) { return p.value == value; });
+                if (known || !ImGui::Selectable(value.label.c_str())) continue;
+                auto& p = ens.parameters.emplace_back();
+                p.value = value;
+                defaults(p, current);
+            }
+            ImGui::EndCombo();
+        }
+    }
+    if (!ens.parameters.empty() && ImGui::BeginTable("##ensemble-parameters", 4, ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Parameter");
+        ImGui::TableSetupColumn("Distribution");
+        ImGui::TableSetupColumn("");
+        ImGui::TableSetupColumn("");
+        ImGui::TableHeadersRow();
+        std::optional<size_t> remove;
+        for (auto ix = 0ul; ix < ens.parameters.size(); ++ix) {
+            auto& p = ens.parameters[ix];
+            with_id id{ix};
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(p.value.label.c_str());
+            ImGui::TableNextColumn();
+            ImGui::SetNextItemWidth(-1);
+            gui_choose("##distribution", p.distribution, ensemble_parameter::distributions);
+            auto [a, b] = parameter_labels(p.distribution);
+            ImGui::TableNextColumn();
+            ImGui::SetNextItemWidth(-1);
+            gui_input_double("##a", p.a);
+            gui_tooltip(a);
+            ImGui::TableNextColumn();
+            ImGui::SetNextItemWidth(-30);
+            gui_input_double("##b", p.b);
+            gui_tooltip(b);
+            ImGui::SameLine();
+            if (!busy && ImGui::SmallButton(icon_delete)) remove = ix;
+        }
+        ImGui::EndTable();
+        if (remove) ens.parameters.erase(ens.parameters.begin() + remove.value());
+    }
+    if (busy) {
+        auto& progress = ens.running->progress();
+        ImGui::ProgressBar(progress.total(), {-40.0f, 0.0f}, progress.label().c_str());
+        ImGui::SameLine();
+        if (ImGui::Button(icon_delete)) ens.running->cancel();
+    } else {
+        ens.should_run = ImGui::Button(frame_format("{} Run ensemble", icon_start));
+        gui_tooltip("Simulate variants with parameters drawn from their distributions.");
+    }
+    if (!ens.error.empty()) ImGui::TextWrapped("%s %s", icon_error, ens.error.c_str());
+
+    if (!ens.bands.empty()) {
+        if (!ens.bands.contains(ens.probe)) ens.probe = ens.bands.begin()->first;
+        {
+            with_item_width width(120.0f);
+            if (ImGui::BeginCombo("Probe", ens.probe.c_str())) {
+                for (const auto& [key, band]: ens.bands) gui_select(key, ens.probe);
+                ImGui::EndCombo();
+            }
+        }
+        const auto& band = ens.bands.at(ens.probe);
+        ImGui::Text("%zu variants", band.runs);
+        if (ImPlot::BeginPlot("##ensemble-bands", {-1, 200})) {
+            ImPlot::SetupAxes("Time (ms)", "Value", ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
+            const auto& ts = band.times;
+            const auto& vs = band.values;
+            auto n = ts.size();
+            ImPlot::SetNextFillStyle(IMPLOT_AUTO_COL, 0.2f);
+            ImPlot::PlotShaded("5-95%", ts.data(), vs[0].data(), vs[4].data(), n);
+            ImPlot::SetNextFillStyle(IMPLOT_AUTO_COL, 0.4f);
+            ImPlot::PlotShaded("25-75%", ts.data(), vs[1].data(), vs[3].data(), n);
+            ImPlot::PlotLine("Median", ts.data(), vs[2].data(), n);
+            ImPlot::EndPlot();
+        }
+    }
+    ImGui::TreePop();
+}
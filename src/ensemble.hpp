@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "simulation.hpp"
+#include "task.hpp"
+
+// Percentiles shown as bands: 5-95, 25-75, and the median.
+constexpr std::array<double, 5> ensemble_percentiles{0.05, 0.25, 0.5, 0.75, 0.95};
+
+// Streaming estimate of `ensemble_percentiles` per time sample by the extended
+// P² algorithm (Raatikainen 1987): a fixed set of markers per sample, so memory
+// does not depend on the number of observations folded in.
+struct quantile_estimator {
+    constexpr static size_t markers = 2*ensemble_percentiles.size() + 3;
+    struct sample {
+        std::array<float, markers> heights = {};
+        std::array<std::uint32_t, markers> positions = {};
+        std::uint32_t count = 0;
+    };
+    std::vector<float> times;
+    std::vector<sample> samples;
+
+    void add(size_t ix, float time, float value);
+    // Estimate of percentile `q` (an index into `ensemble_percentiles`) at sample `ix`.
+    float quantile(size_t ix, size_t q) const;
+};
+
+struct percentile_band {
+    std::vector<float> times;
+    std::array<std::vector<float>, ensemble_percentiles.size()> values;
+    size_t runs = 0; // Smallest number of variants seen at any sample
+};
+
+struct ensemble_parameter {
+    constexpr static std::array<const char*, 3> distributions{"Normal", "Log-normal", "Uniform"};
+    model_value value;
+    std::string distribution = distributions.front();
+    // Normal: mean and standard deviation; log-normal: median and sigma of the
+    // log of the magnitude, keeping the sign; uniform: low and high.
+    double a = 0.0, b = 0.0;
+};
+
+double draw(const ensemble_parameter&, std::mt19937&);
+
+// Monte Carlo ensemble: variants with parameters drawn at random, run `batch`
+// cells at a time, reduced to percentile bands per probe as samples arrive.
+struct ensemble {
+    int size  = 100;
+    int batch = 64;
+    unsigned seed = 1;
+    std::vector<ensemble_parameter> parameters;
+    std::string probe; // Shown, "{tag}/{index}"
+
+    bool should_run = false;
+    std::optional<task<std::map<std::string, percentile_band>>> running;
+    std::map<std::string, percentile_band> bands; // By "{tag}/{index}"
+    std::string error;
+};
+
+// Run `size` variants of `base` in batches of `batch` cells, folding every
+// probe's samples into percentile bands after each batch. Values for
+// `parameters` are drawn from `seed` and turned into the decor by `decor`.
+std::map<std::string, percentile_band> run_ensemble(const model& base, const variant_decor_fn& decor,
+                                                    const std::vector<ensemble_parameter>& parameters,
+                                                    size_t size, size_t batch, unsigned seed,
+                                                    double until, double dt, task_progress&);
+void poll_ensemble(ensemble&);
+void gui_ensemble(ensemble&, const model_values_fn& available);
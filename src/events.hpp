@@ -7,6 +7,7 @@
 
 struct evt_add_ion { std::string name; int charge; };
 struct evt_del_ion { id_type id; };
+struct evt_upd_ion { id_type id; };
 struct evt_add_mechanism { id_type region; };
 struct evt_del_mechanism { id_type id; };
 struct evt_add_probe { id_type locset; };
@@ -24,7 +25,7 @@ template <typename Item> struct evt_del_locdef { id_type id; };
 
 using event = std::variant<evt_upd_cv,
                            evt_add_mechanism,                                evt_del_mechanism,
-                           evt_add_ion,                                      evt_del_ion,
+                           evt_add_ion,             evt_upd_ion,             evt_del_ion,
                            evt_add_probe,                                    evt_del_probe,
                            evt_add_stimulus,                                 evt_del_stimulus,
                            evt_add_detector,                                 evt_del_detector,
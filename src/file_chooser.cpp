@@ -1,7 +1,76 @@
 #include "file_chooser.hpp"
+
+#include <algorithm>
+#include <chrono>
+
 #include "icons.hpp"
 #include "gui.hpp"
 
+namespace {
+    constexpr auto rescan_interval = std::chrono::seconds(2);
+    constexpr auto max_listings    = 64ul;
+
+    void refresh_listing(file_chooser_state& state) {
+        if (state.scanning && state.scanning->ready()) {
+            auto done = std::move(state.scanning.value());
+            state.scanning.reset();
+            auto listing = done.get();
+            if (state.listings.size() >= max_listings) state.listings.clear();
+            state.listings[listing.dir.string()] = std::move(listing);
+        }
+        if (state.scanning) return;
+        auto it = state.listings.find(state.cwd.string());
+        if (it == state.listings.end() || timer::now() - it->second.scanned > rescan_interval) {
+            state.scanning.emplace(std::vector<std::string>{"Scanning"},
+                                   [dir=state.cwd](task_progress&) { return scan_dir(dir); });
+        }
+    }
+
+    void refresh_rows(file_chooser_state& state, const dir_listing& listing) {
+        if (state.rows_dir     == listing.dir
+         && state.rows_scanned == listing.scanned
+         && state.rows_hidden  == state.show_hidden
+         && state.rows_filter  == state.filter) return;
+        state.rows.clear();
+        for (auto ix = 0ul; ix < listing.entries.size(); ++ix) {
+            const auto& entry = listing.entries[ix];
+            if (!state.show_hidden && (entry.name.front() == '.')) continue;
+            if (!entry.is_dir && state.filter && state.filter.value() != entry.path.extension()) continue;
+            state.rows.push_back(ix);
+        }
+        state.rows_dir     = listing.dir;
+        state.rows_scanned = listing.scanned;
+        state.rows_hidden  = state.show_hidden;
+        state.rows_filter  = state.filter;
+    }
+}
+
+dir_listing scan_dir(const std::filesystem::path& dir) {
+    dir_listing result{.dir=dir, .scanned=timer::now()};
+    try {
+        std::error_code ec;
+        for (const auto& it: std::filesystem::directory_iterator(dir, std::filesystem::directory_options::skip_permission_denied)) {
+            const auto& path = it.path();
+            std::string fn = path.filename();
+            if (fn.empty()) continue;
+            if (it.is_directory(ec)) {
+                result.entries.push_back({fn, path, true});
+            } else if (it.is_regular_file(ec)) {
+                result.entries.push_back({fn, path, false});
+            }
+        }
+    } catch (const std::filesystem::filesystem_error& e) {
+        log_warn("Could not list {}: {}", dir.string(), e.what());
+        result.error = e.what();
+    }
+    std::sort(result.entries.begin(), result.entries.end(),
+              [](const auto& a, const auto& b) {
+                  if (a.is_dir != b.is_dir) return a.is_dir;
+                  return a.name < b.name;
+              });
+    return result;
+}
+
 void gui_dir_view(file_chooser_state& state) {
     // Draw the current path + show hidden
     {
@@ -11,7 +80,7 @@ void gui_dir_view(file_chooser_state& state) {
         acc /= part;
         if ("/" == part) continue;
         ImGui::SameLine(0.0f, 0.0f);
-        if (ImGui::Button(fmt::format("/ {}", part.c_str()).c_str())) state.cwd = acc;
+        if (ImGui::Button(frame_format("/ {}", part.c_str()))) state.cwd = acc;
       }
       gui_right_margin();
       gui_toggle(icon_show, icon_hide, state.show_hidden);
@@ -35,32 +104,32 @@ void gui_dir_view(file_chooser_state& state) {
                          -3.00f*ImGui::GetTextLineHeightWithSpacing()},
                         true);
 
-      std::vector<std::tuple<std::string, std::filesystem::path>> dirnames;
-      std::vector<std::tuple<std::string, std::filesystem::path>> filenames;
-
-      for (const auto& it: std::filesystem::directory_iterator(state.cwd)) {
-        const auto& path = it.path();
-        const auto& ext = path.extension();
-        std::string fn = path.filename();
-        if (fn.empty() || (!state.show_hidden && (fn.front() == '.'))) continue;
-        if (it.is_directory()) dirnames.push_back({fn, path});
-        if (state.filter && state.filter.value() != ext) continue;
-        if (it.is_regular_file()) filenames.push_back({fn, path});
-      }
-
-      std::sort(filenames.begin(), filenames.end());
-      std::sort(dirnames.begin(), dirnames.end());
-
-      for (const auto& [dn, path]: dirnames) {
-        auto lbl = fmt::format("{} {}", icon_folder, dn);
-        ImGui::Selectable(lbl.c_str(), false);
-        if (ImGui::IsItemHovered() && (ImGui::IsMouseDoubleClicked(0) || ImGui::IsKeyPressed(ImGuiKey_Enter))) {
-          state.cwd = path;
+      refresh_listing(state);
+      if (auto it = state.listings.find(state.cwd.string()); it != state.listings.end()) {
+        const auto& listing = it->second;
+        refresh_rows(state, listing);
+        if (!listing.error.empty()) ImGui::TextUnformatted(listing.error.c_str());
+        // Change directory only after drawing, `listing` must stay valid until then.
+        std::optional<std::filesystem::path> next;
+        ImGuiListClipper clipper;
+        clipper.Begin(state.rows.size());
+        while (clipper.Step()) {
+          for (auto row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+            const auto& entry = listing.entries[state.rows[row]];
+            if (entry.is_dir) {
+              ImGui::Selectable(frame_format("{} {}", icon_folder, entry.name), false);
+              if (ImGui::IsItemHovered() && (ImGui::IsMouseDoubleClicked(0) || ImGui::IsKeyPressed(ImGuiKey_Enter))) next = entry.path;
+            } else {
+              if (ImGui::Selectable(entry.name.c_str(), entry.path == state.file)) state.file = entry.path;
+            }
+          }
+        }
+        if (next) {
+          state.cwd = next.value();
           state.file.clear();
         }
-      }
-      for (const auto& [fn, path]: filenames) {
-        if (ImGui::Selectable(fn.c_str(), path == state.file)) state.file = path;
+      } else {
+        ImGui::TextUnformatted("Scanning...");
       }
       ImGui::EndChild();
     }
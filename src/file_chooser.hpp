@@ -6,9 +6,27 @@
 #include <filesystem>
 #include <variant>
 #include <optional>
+#include <unordered_map>
 
+#include "task.hpp"
 #include "utils.hpp"
 
+struct dir_entry {
+    std::string name;
+    std::filesystem::path path;
+    bool is_dir = false;
+};
+
+// Contents of a directory, sub-directories first, each sorted by name.
+struct dir_listing {
+    std::filesystem::path  dir;
+    std::vector<dir_entry> entries;
+    std::string            error;
+    timer::time_point      scanned;
+};
+
+dir_listing scan_dir(const std::filesystem::path& dir);
+
 struct file_chooser_state {
     std::filesystem::path cwd = std::filesystem::current_path();
     std::optional<std::string> filter = {};
@@ -16,6 +34,17 @@ struct file_chooser_state {
     bool use_filter;
     std::filesystem::path file, home, desk, docs;
 
+    // Listings are cached per directory and rescanned periodically off-thread.
+    std::unordered_map<std::string, dir_listing> listings;
+    std::optional<task<dir_listing>> scanning;
+    // Indices into the listing of `cwd` that pass the hidden/extension filters;
+    // rebuilt only when one of the inputs below changes.
+    std::vector<size_t> rows;
+    std::filesystem::path rows_dir;
+    std::optional<std::string> rows_filter;
+    bool rows_hidden = false;
+    timer::time_point rows_scanned;
+
     file_chooser_state() {
         if (auto hd = getenv("HOME"); hd != nullptr) {
             home = hd;
@@ -0,0 +1,289 @@
+#include "fitter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include <fmt/format.h>
+#include <implot.h>
+
+#include "gui.hpp"
+#include "icons.hpp"
+
+namespace {
+    // Eigen decomposition of the symmetric, row-major n x n `a` by cyclic Jacobi
+    // rotations: a = v diag(w) v^T. Fine for the handful of parameters we fit.
+    void eigen(size_t n, std::vector<double> a, std::vector<double>& w, std::vector<double>& v) {
+        v.assign(n*n, 0.0);
+        for (auto ix = 0ul; ix < n; ++ix) v[ix*n + ix] = 1.0;
+        for (auto sweep = 0; sweep < 64; ++sweep) {
+            auto off = 0.0;
+            for (auto p = 0ul; p < n; ++p) {
+                for (auto q = p + 1; q < n; ++q) off += a[p*n + q]*a[p*n + q];
+            }
+            if (off < 1e-30) break;
+            for (auto p = 0ul; p < n; ++p) {
+                for (auto q = p + 1; q < n; ++q) {
+                    auto apq = a[p*n + q];
+                    if (apq == 0.0) continue;
+                    auto theta = (a[q*n + q] - a[p*n + p])/(2*apq);
+                    auto t = (theta >= 0 ? 1.0 : -1.0)/(std::abs(theta) + std::sqrt(theta*theta + 1));
+                    auto c = 1/std::sqrt(t*t + 1), s = t*c;
+                    for (auto k = 0ul; k < n; ++k) {
+                        auto akp = a[k*n + p], akq = a[k*n + q];
+                        a[k*n + p] = c*akp - s*akq;
+                        a[k*n + q] = s*akp + c*akq;
+                    }
+                    for (auto k = 0ul; k < n; ++k) {
+                        auto apk = a[p*n + k], aqk = a[q*n + k];
+                        a[p*n + k] = c*apk - s*aqk;
+                        a[q*n + k] = s*apk + c*aqk;
+                    }
+                    for (auto k = 0ul; k < n; ++k) {
+                        auto vkp = v[k*n + p], vkq = v[k*n + q];
+                        v[k*n + p] = c*vkp - s*vkq;
+                        v[k*n + q] = s*vkp + c*vkq;
+                    }
+                }
+            }
+        }
+        w.resize(n);
+        for (auto ix = 0ul; ix < n; ++ix) w[ix] = a[ix*n + ix];
+    }
+
+    double norm(const std::vector<double>& xs) { return std::sqrt(std::inner_product(xs.begin(), xs.end(), xs.begin(), 0.0)); }
+}
+
+cma_es::cma_es(std::vector<double> start, double sigma_, size_t lambda_, unsigned seed):
+    n{start.size()}, sigma{sigma_}, mean{std::move(start)}, rng{seed}
+{
+    lambda = lambda_ ? lambda_ : 4 + size_t(3*std::log(double(n)));
+    mu     = lambda/2;
+    for (auto ix = 0ul; ix < mu; ++ix) weights.push_back(std::log(mu + 0.5) - std::log(ix + 1.0));
+    auto sum = std::accumulate(weights.begin(), weights.end(), 0.0);
+    for (auto& w: weights) w /= sum;
+    mueff = 1/std::inner_product(weights.begin(), weights.end(), weights.begin(), 0.0);
+    cc    = (4 + mueff/n)/(n + 4 + 2*mueff/n);
+    cs    = (mueff + 2)/(n + mueff + 5);
+    c1    = 2/((n + 1.3)*(n + 1.3) + mueff);
+    cmu   = std::min(1 - c1, 2*(mueff - 2 + 1/mueff)/((n + 2)*(n + 2) + mueff));
+    damps = 1 + 2*std::max(0.0, std::sqrt((mueff - 1)/(n + 1)) - 1) + cs;
+    chi_n = std::sqrt(n)*(1 - 1.0/(4*n) + 1.0/(21.0*n*n));
+    pc.assign(n, 0.0);
+    ps.assign(n, 0.0);
+    C.assign(n*n, 0.0);
+    for (auto ix = 0ul; ix < n; ++ix) C[ix*n + ix] = 1.0;
+    B = C;
+    D.assign(n, 1.0);
+}
+
+std::vector<std::vector<double>> cma_es::ask() {
+    std::vector<double> w;
+    eigen(n, C, w, B);
+    for (auto ix = 0ul; ix < n; ++ix) D[ix] = std::sqrt(std::max(w[ix], 1e-20));
+    std::normal_distribution<double> normal;
+    std::vector<std::vector<double>> result(lambda, std::vector<double>(n));
+    std::vector<double> z(n);
+    for (auto& x: result) {
+        for (auto& v: z) v = normal(rng);
+        for (auto row = 0ul; row < n; ++row) {
+            auto y = 0.0;
+            for (auto col = 0ul; col < n; ++col) y += B[row*n + col]*D[col]*z[col];
+            x[row] = std::clamp(mean[row] + sigma*y, 0.0, 1.0);
+        }
+    }
+    return result;
+}
+
+void cma_es::tell(const std::vector<std::vector<double>>& xs, const std::vector<double>& scores) {
+    std::vector<size_t> order(xs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](auto l, auto r) { return scores[l] < scores[r]; });
+
+    auto old = mean;
+    std::fill(mean.begin(), mean.end(), 0.0);
+    for (auto ix = 0ul; ix < mu; ++ix) {
+        for (auto jx = 0ul; jx < n; ++jx) mean[jx] += weights[ix]*xs[order[ix]][jx];
+    }
+    std::vector<double> step(n);
+    for (auto jx = 0ul; jx < n; ++jx) step[jx] = (mean[jx] - old[jx])/sigma;
+
+    // C^-1/2 step = B D^-1 B^T step
+    std::vector<double> tmp(n, 0.0), whitened(n, 0.0);
+    for (auto col = 0ul; col < n; ++col) {
+        for (auto row = 0ul; row < n; ++row) tmp[col] += B[row*n + col]*step[row];
+        tmp[col] /= D[col];
+    }
+    for (auto row = 0ul; row < n; ++row) {
+        for (auto col = 0ul; col < n; ++col) whitened[row] += B[row*n + col]*tmp[col];
+    }
+    for (auto jx = 0ul; jx < n; ++jx) ps[jx] = (1 - cs)*ps[jx] + std::sqrt(cs*(2 - cs)*mueff)*whitened[jx];
+    auto hsig = norm(ps)/std::sqrt(1 - std::pow(1 - cs, 2.0*(generation + 1)))/chi_n < 1.4 + 2.0/(n + 1);
+    for (auto jx = 0ul; jx < n; ++jx) pc[jx] = (1 - cc)*pc[jx] + hsig*std::sqrt(cc*(2 - cc)*mueff)*step[jx];
+
+    auto decay = 1 - c1 - cmu + (hsig ? 0.0 : c1*cc*(2 - cc));
+    for (auto row = 0ul; row < n; ++row) {
+        for (auto col = 0ul; col <= row; ++col) {
+            auto rank_mu = 0.0;
+            for (auto ix = 0ul; ix < mu; ++ix) {
+                const auto& x = xs[order[ix]];
+                rank_mu += weights[ix]*(x[row] - old[row])*(x[col] - old[col]);
+            }
+            auto c = decay*C[row*n + col] + c1*pc[row]*pc[col] + cmu*rank_mu/(sigma*sigma);
+            C[row*n + col] = C[col*n + row] = c;
+        }
+    }
+    sigma = std::min(sigma*std::exp((cs/damps)*(norm(ps)/chi_n - 1)), 1.0);
+    ++generation;
+}
+
+std::vector<double> fitter::normalise(const std::vector<double>& xs) const {
+    std::vector<double> result;
+    for (auto ix = 0ul; ix < parameters.size(); ++ix) {
+        const auto& p = parameters[ix];
+        result.push_back(p.hi > p.lo ? std::clamp((xs[ix] - p.lo)/(p.hi - p.lo), 0.0, 1.0) : 0.5);
+    }
+    return result;
+}
+
+std::vector<double> fitter::denormalise(const std::vector<double>& xs) const {
+    std::vector<double> result;
+    for (auto ix = 0ul; ix < parameters.size(); ++ix) {
+        const auto& p = parameters[ix];
+        result.push_back(p.lo + xs[ix]*(p.hi - p.lo));
+    }
+    return result;
+}
+
+std::vector<double> threshold_crossings(const float* times, const float* values, size_t n, double threshold) {
+    std::vector<double> result;
+    for (auto ix = 1ul; ix < n; ++ix) {
+        if (values[ix - 1] < threshold && values[ix] >= threshold) {
+            auto f = (threshold - values[ix - 1])/(values[ix] - values[ix - 1]);
+            result.push_back(times[ix - 1] + f*(times[ix] - times[ix - 1]));
+        }
+    }
+    return result;
+}
+
+double fit_score(const std::string& objective, double threshold, const fit_target& target, const model_run& run) {
+    auto it = std::find_if(run.series.begin(), run.series.end(),
+                           [&](const auto& s) { return fmt::format("{}/{}", s.tag, s.index) == target.key; });
+    if (it == run.series.end() || it->times.empty() || target.times.empty()) return std::numeric_limits<double>::infinity();
+    const auto& ts = it->times;
+    const auto& vs = it->values;
+    if (objective == "Spike times") {
+        auto xs = threshold_crossings(ts.data(), vs.data(), ts.size(), threshold);
+        auto ys = threshold_crossings(target.times.data(), target.values.data(), target.times.size(), threshold);
+        // Paired in order; every unmatched spike costs the whole duration.
+        auto duration = target.times.back() - target.times.front();
+        auto result = duration*std::abs(double(xs.size()) - double(ys.size()));
+        for (auto ix = 0ul; ix < std::min(xs.size(), ys.size()); ++ix) result += std::abs(xs[ix] - ys[ix]);
+        return result/std::max<size_t>({xs.size(), ys.size(), 1});
+    }
+    // RMSE at the target's sample times, interpolating the candidate
+    auto sum = 0.0;
+    auto jx = 0ul;
+    for (auto ix = 0ul; ix < target.times.size(); ++ix) {
+        auto t = target.times[ix];
+        while (jx + 1 < ts.size() && ts[jx + 1] < t) ++jx;
+        auto v = vs[jx];
+        if (jx + 1 < ts.size() && ts[jx + 1] > ts[jx]) {
+            auto f = std::clamp((t - ts[jx])/(ts[jx + 1] - ts[jx]), 0.0f, 1.0f);
+            v += f*(vs[jx + 1] - vs[jx]);
+        }
+        sum += (v - target.values[ix])*(v - target.values[ix]);
+    }
+    return std::sqrt(sum/target.times.size());
+}
+
+void gui_fitter(fitter& fit, const model_values_fn& available, const simulation& sim) {
+    if (!gui_tree("Parameter fit")) return;
+    auto busy = fit.cma.has_value();
+    {
+        with_item_width width(120.0f);
+        auto current = fit.target ? fit.target->name : std::string{};
+        if (ImGui::BeginCombo("Target", current.c_str())) {
+            for (const auto& key: sim.trace_keys) {
+                if (ImGui::Selectable(frame_format("Probe {}", key))) {
+                    auto& target = fit.target.emplace();
+                    target.name = fmt::format("Probe {}", key);
+                    target.key  = key;
+                    sim.traces.at(sim.tag_to_id.at(key).value).data.copy(target.times, target.values);
+                }
+            }
+            ImGui::EndCombo();
+        }
+        gui_tooltip("Copy the trace of this probe from the current run as the target.");
+        gui_choose("Objective", fit.objective, fitter::objectives);
+        if (fit.objective == "Spike times") gui_input_double("Threshold", fit.threshold, "mV");
+        ImGui::InputInt("Generations", &fit.generations);
+        fit.generations = std::max(fit.generations, 1);
+        if (!busy && ImGui::BeginCombo("##add-fit-parameter", frame_format("{} Parameter", icon_add))) {
+            for (const auto& [value, current]: available()) {
+                auto known = std::any_of(fit.parameters.begin(), fit.parameters.end(), [&](const auto& p) { return p.value == value; });
+                if (known || !ImGui::Selectable(value.label.c_str())) continue;
+                auto lo = current == 0 ? -1.0 : std::min(0.5*current, 2.0*current);
+                auto hi = current == 0 ?  1.0 : std::max(0.5*current, 2.0*current);
+                fit.parameters.push_back({value, lo, hi});
+            }
+            ImGui::EndCombo();
+        }
+    }
+    if (!fit.parameters.empty() && ImGui::BeginTable("##fit-parameters", 5, ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Parameter");
+        ImGui::TableSetupColumn("Low");
+        ImGui::TableSetupColumn("High");
+        ImGui::TableSetupColumn("Best");
+        ImGui::TableSetupColumn("");
+        ImGui::TableHeadersRow();
+        std::optional<size_t> remove;
+        for (auto ix = 0ul; ix < fit.parameters.size(); ++ix) {
+            auto& p = fit.parameters[ix];
+            with_id id{ix};
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(p.value.label.c_str());
+            ImGui::TableNextColumn();
+            ImGui::SetNextItemWidth(-1);
+            gui_input_double("##lo", p.lo);
+            ImGui::TableNextColumn();
+            ImGui::SetNextItemWidth(-1);
+            gui_input_double("##hi", p.hi);
+            ImGui::TableNextColumn();
+            if (ix < fit.best.size()) ImGui::Text("%.4g", fit.best[ix]);
+            ImGui::TableNextColumn();
+            if (!busy && ImGui::SmallButton(icon_delete)) remove = ix;
+        }
+        ImGui::EndTable();
+        if (remove) {
+            fit.parameters.erase(fit.parameters.begin() + remove.value());
+            fit.best.clear();
+        }
+    }
+    if (busy) {
+        if (fit.evaluating) {
+            auto& progress = fit.evaluating->progress();
+            ImGui::ProgressBar(progress.total(), {-40.0f, 0.0f}, frame_format("Generation {}/{}", fit.cma->generation + 1, fit.generations));
+            ImGui::SameLine();
+            if (ImGui::Button(icon_delete)) fit.evaluating->cancel();
+        }
+    } else {
+        fit.should_start = ImGui::Button(frame_format("{} Fit", icon_start));
+        gui_tooltip("Run a CMA-ES, each generation as one simulation of all candidates.");
+        if (!fit.best.empty()) {
+            ImGui::SameLine();
+            fit.should_apply = ImGui::Button("Apply best");
+        }
+    }
+    if (!fit.error.empty()) ImGui::TextWrapped("%s %s", icon_error, fit.error.c_str());
+    if (!fit.scores.empty()) {
+        ImGui::Text("Best score: %.4g", fit.best_score);
+        if (ImPlot::BeginPlot("##fit-scores", {-1, 160})) {
+            ImPlot::SetupAxes("Generation", "Score", ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
+            ImPlot::PlotLine("Best", fit.scores.data(), fit.scores.size());
+            ImPlot::EndPlot();
+        }
+    }
+    ImGui::TreePop();
+}
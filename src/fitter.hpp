@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <limits>
+#include <optional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "simulation.hpp"
+#include "task.hpp"
+
+// Covariance matrix adaptation evolution strategy (Hansen's (mu/mu_w, lambda)
+// variant), minimising over the unit cube. Samples are clamped into the cube.
+struct cma_es {
+    size_t n = 0, lambda = 0, mu = 0;
+    std::vector<double> weights;
+    double mueff = 0, cc = 0, cs = 0, c1 = 0, cmu = 0, damps = 0, chi_n = 0;
+    double sigma = 0.3;
+    std::vector<double> mean, pc, ps;
+    std::vector<double> C, B, D; // C and B are row-major n x n, D are the square roots of the eigenvalues
+    size_t generation = 0;
+    std::mt19937 rng;
+
+    cma_es(std::vector<double> start, double sigma, size_t lambda=0, unsigned seed=42);
+    std::vector<std::vector<double>> ask();
+    // Scores of the population handed out by `ask`, lower is better.
+    void tell(const std::vector<std::vector<double>>& xs, const std::vector<double>& scores);
+};
+
+struct fit_parameter {
+    model_value value;
+    double lo = 0.0, hi = 1.0;
+};
+
+struct fit_target {
+    std::string name;
+    std::string key; // Probe trace to compare, "{tag}/{index}"
+    std::vector<float> times, values;
+};
+
+// Fits parameters to a target trace; one generation is one batched simulation.
+struct fitter {
+    constexpr static std::array<const char*, 2> objectives{"RMSE", "Spike times"};
+    std::string objective = objectives.front();
+    double threshold = -20.0; // [mV] Upward crossings count as spikes
+    int generations  = 30;
+    std::vector<fit_parameter> parameters;
+    std::optional<fit_target> target;
+
+    bool should_start = false;
+    bool should_apply = false;
+
+    std::optional<cma_es> cma;                    // Set while fitting
+    std::vector<std::vector<double>> population;  // Being evaluated, normalised
+    std::optional<task<std::vector<double>>> evaluating;
+    std::vector<double> best;                     // Per parameter
+    double best_score = std::numeric_limits<double>::infinity();
+    std::vector<double> scores;                   // Best per generation
+    std::string error;
+
+    std::vector<double> normalise(const std::vector<double>&) const;
+    std::vector<double> denormalise(const std::vector<double>&) const;
+};
+
+// Upward crossings of `threshold`, interpolated between samples.
+std::vector<double> threshold_crossings(const float* times, const float* values, size_t n, double threshold);
+// Distance of the target's probe in `run` to the target, lower is better.
+double fit_score(const std::string& objective, double threshold, const fit_target&, const model_run&);
+
+// Targets are taken from the traces of `sim`.
+void gui_fitter(fitter&, const model_values_fn& available, const simulation& sim);
@@ -485,6 +485,12 @@ geometry::geometry() {
     make_program("branch", object_program);
     make_program("marker", marker_program);
     make_program("iexpr",  iexpr_program);
+    make_program("playback", playback_program);
+    // Texture units are fixed, so set them once.
+    glUseProgram(playback_program);
+    glUniform1i(glGetUniformLocation(playback_program, "cmap"),   0);
+    glUniform1i(glGetUniformLocation(playback_program, "values"), 1);
+    glUseProgram(0);
 
     // matplotlib inferno
     cmaps["inferno"] = make_colormap({{0.001462, 0.000466, 0.013866, 1.0},
@@ -569,6 +575,22 @@ void geometry::render(const view_state& vs, const glm::vec2& where) {
             ::render(iexpr_program, model, view, vs.camera, light_color, iexprs.items, cmaps[cmap]);
             glDisable(GL_CULL_FACE);
         }
+        // ... recordings ...
+        if (playback.active) {
+            glFrontFace(GL_CW);
+            glEnable(GL_CULL_FACE);
+            glUseProgram(playback_program);
+            set_uniform(playback_program, "lo",    playback_lo);
+            set_uniform(playback_program, "scale", playback_scale);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_BUFFER, playback_tex);
+            glActiveTexture(GL_TEXTURE0);
+            ::render(playback_program, model, view, vs.camera, light_color, {playback}, cmaps[cmap]);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+            glActiveTexture(GL_TEXTURE0);
+            glDisable(GL_CULL_FACE);
+        }
         // ... axes ...
         {
             glFrontFace(GL_CW);
@@ -628,7 +650,7 @@ void geometry::make_iexpr(const iexpr_info& iexpr, renderable& r) {
     std::vector<unsigned> idcs;
     for (const auto& segment: segments) {
         auto idx = id_to_index[segment.id];
-        auto [pc, dc] = iexpr.values.at(segment.id);
+        auto [pc, dc] = iexpr.values[segment.id];
         for (auto idy = n_indices*idx; idy < n_indices*(idx + 1); ++idy) {
             idcs.push_back(indices[idy]);
         }
@@ -651,30 +673,76 @@ void geometry::make_iexpr(const iexpr_info& iexpr, renderable& r) {
     r.active    = true;
 }
 
+void geometry::make_playback(const std::vector<std::pair<unsigned, unsigned>>& segment_cables, size_t n_cables) {
+    // Static per vertex: the cable to look up; same layout as in `make_iexpr`.
+    std::vector<float> cols;
+    std::vector<unsigned> idcs;
+    for (const auto& segment: segments) {
+        auto idx = id_to_index[segment.id];
+        auto none = unsigned(n_cables);
+        auto [pc, dc] = segment.id < segment_cables.size() ? segment_cables[segment.id] : std::pair{none, none};
+        for (auto idy = n_indices*idx; idy < n_indices*(idx + 1); ++idy) {
+            idcs.push_back(indices[idy]);
+        }
+        cols.push_back(pc);
+        cols.push_back(dc);
+        for (auto face = 0ul; face < n_faces; ++face) {
+            cols.push_back(pc);
+            cols.push_back(pc);
+            cols.push_back(dc);
+            cols.push_back(dc);
+        }
+    }
+
+    glDeleteVertexArrays(1, &playback.vao);
+    glDeleteBuffers(1, &playback.cbo);
+    playback.cbo       = make_buffer_object(cols, GL_ARRAY_BUFFER);
+    playback.vao       = make_vao(vbo, idcs, {{0.0f, 0.0f, 0.0f}}, playback.cbo);
+    playback.count     = idcs.size();
+    playback.instances = 1;
+    playback.zorder    = -1.0f;
+    playback.active    = true;
+
+    if (!playback_tbo) glGenBuffers(1, &playback_tbo);
+    if (!playback_tex) glGenTextures(1, &playback_tex);
+    glBindBuffer(GL_TEXTURE_BUFFER, playback_tbo);
+    // One extra slot for segments without a cable
+    glBufferData(GL_TEXTURE_BUFFER, (n_cables + 1)*sizeof(float), nullptr, GL_STREAM_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, playback_tex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, playback_tbo);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    playback_size = n_cables;
+    gl_check_error("make playback");
+}
+
+void geometry::set_playback(const float* values, float lo, float hi) {
+    playback_lo    = lo;
+    playback_scale = hi > lo ? 1.0f/(hi - lo) : 0.0f;
+    glBindBuffer(GL_TEXTURE_BUFFER, playback_tbo);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, playback_size*sizeof(float), values);
+    glBufferSubData(GL_TEXTURE_BUFFER, playback_size*sizeof(float), sizeof(float), &lo);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
 void geometry::make_ruler() {
     make_axes(ax, rescale);
 }
 
-void geometry::load_geometry(const arb::morphology& morph, bool reset) {
-    if (reset) {
-        locsets.clear();
-        regions.clear();
-        iexprs.clear();
-        cv_boundaries.active = false;
-    }
-    clear();
-    n_vertices  = n_faces*4 + 2;  // Faces: 4 vertices 2 are shared. Caps: three per face, center is shared
-    n_triangles = n_faces*4;      // Each face is a quad made from 2 tris, caps have one tri per face
-    n_indices   = n_triangles*3;  // Three indices (reference to vertex) per tri
+mesh make_mesh(const arb::morphology& morph, size_t n_faces, float scale, task_progress* progress) {
+    mesh result;
+    result.n_faces = n_faces;
+    auto n_vertices = n_faces*4 + 2;  // Faces: 4 vertices 2 are shared. Caps: three per face, center is shared
+    auto n_indices  = n_faces*4*3;    // Each face is a quad made from 2 tris, caps have one tri per face; three indices per tri
     {
         auto index = 0ul;
         for (auto branch = 0ul; branch < morph.num_branches(); ++branch) {
             std::vector<size_t> tmp;
             for (const auto& segment: morph.branch_segments(branch)) {
                 auto id = segment.id;
-                segments.push_back(segment);
-                id_to_branch[id] = branch;
-                id_to_index[id]  = index;
+                result.segments.push_back(segment);
+                result.id_to_branch[id] = branch;
+                result.id_to_index[id]  = index;
                 tmp.push_back(id);
                 index++;
             }
@@ -691,28 +759,32 @@ void geometry::load_geometry(const arb::morphology& morph, bool reset) {
                 if (*it == hi + 1) {
                     hi = *it++;
                 } else {
-                    branch_to_ids[branch].emplace_back(lo, hi);
+                    result.branch_to_ids[branch].emplace_back(lo, hi);
                     it++;
                     lo = hi = *it++;
                 }
             }
-            branch_to_ids[branch].emplace_back(lo, hi);
+            result.branch_to_ids[branch].emplace_back(lo, hi);
         }
     }
+    auto& segments = result.segments;
+    auto& vertices = result.vertices;
+    auto& indices  = result.indices;
     log_info("Loaded {} segments and {} branches", segments.size(), morph.num_branches());
 
     log_info("Making geometry");
     if (segments.empty()) {
         log_info("Empty geometry");
-        return;
+        return result;
     }
 
-    root = {(float) segments[0].prox.x, (float) segments[0].prox.y, (float) segments[0].prox.z};
+    auto root = glm::vec3{(float) segments[0].prox.x, (float) segments[0].prox.y, (float) segments[0].prox.z};
     log_debug("New root x={} y={} z={}", root.x, root.y, root.z);
     {
         vertices.reserve(segments.size()*n_vertices);
         indices.reserve(segments.size()*n_indices);
         for (auto ix = 0ul; ix < segments.size(); ++ix) {
+            if (progress && (ix % 1024 == 0)) progress->advance(ix, segments.size());
             if (indices.size() != segments[ix].id*n_indices)  log_error("Size mismatch: indices ./. segments");
             const auto& [id, prox, dist, tag] = segments[ix];
             // Shift to root and find vector along the segment
@@ -726,10 +798,9 @@ void geometry::load_geometry(const arb::morphology& morph, bool reset) {
     }
     log_debug("Frustra generated: {} ({} points)", indices.size()/n_indices, vertices.size());
 
-
     {
         // Re-scale into [-1, 1]^3 box
-        rescale = ax.scale;
+        auto rescale = scale;
         for (const auto& tri: vertices) {
             rescale = std::max(rescale, std::abs(tri.position.x));
             rescale = std::max(rescale, std::abs(tri.position.y));
@@ -737,7 +808,39 @@ void geometry::load_geometry(const arb::morphology& morph, bool reset) {
         }
         for(auto& tri: vertices) tri.position /= rescale;
         log_debug("Geometry re-scaled by 1/{}", rescale);
+        result.rescale = rescale;
     }
+    result.root = root;
+    return result;
+}
+
+void geometry::load_geometry(const arb::morphology& morph, bool reset) {
+    load_mesh(make_mesh(morph, n_faces, ax.scale), reset);
+}
+
+void geometry::load_mesh(mesh&& m, bool reset) {
+    if (reset) {
+        locsets.clear();
+        regions.clear();
+        iexprs.clear();
+        cv_boundaries.active = false;
+    }
+    clear();
+    n_faces     = m.n_faces;
+    n_vertices  = n_faces*4 + 2;  // Faces: 4 vertices 2 are shared. Caps: three per face, center is shared
+    n_triangles = n_faces*4;      // Each face is a quad made from 2 tris, caps have one tri per face
+    n_indices   = n_triangles*3;  // Three indices (reference to vertex) per tri
+
+    segments      = std::move(m.segments);
+    vertices      = std::move(m.vertices);
+    indices       = std::move(m.indices);
+    id_to_index   = std::move(m.id_to_index);
+    id_to_branch  = std::move(m.id_to_branch);
+    branch_to_ids = std::move(m.branch_to_ids);
+    if (segments.empty()) return;
+
+    root    = m.root;
+    rescale = m.rescale;
     vbo = make_buffer_object(vertices, GL_ARRAY_BUFFER);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     make_ruler();
@@ -750,5 +853,6 @@ void geometry::clear() {
     id_to_branch.clear();
     segments.clear();
     branch_to_ids.clear();
+    playback.active = false;
     rescale = -1;
 }
@@ -23,6 +23,7 @@ using namespace gl;
 #include "view_state.hpp"
 #include "utils.hpp"
 #include "component.hpp"
+#include "task.hpp"
 
 struct point {
   glm::vec3 position = {0.0f, 0.0f, 0.0f};
@@ -73,6 +74,23 @@ struct axes {
   bool                    active = true;
 };
 
+// CPU side of the cell geometry; can be built away from the render thread.
+struct mesh {
+  std::vector<arb::msegment> segments;
+  std::vector<point>         vertices;
+  std::vector<unsigned>      indices;
+  std::unordered_map<size_t, size_t> id_to_index;
+  std::unordered_map<size_t, size_t> id_to_branch;
+  std::unordered_map<size_t, std::vector<std::pair<size_t, size_t>>> branch_to_ids;
+
+  size_t    n_faces = 16;
+  float     rescale = -1.0f;
+  glm::vec3 root    = {0.0f, 0.0f, 0.0f};
+};
+
+// Generate frustra for all segments, rescaled into a box no smaller than `scale`.
+mesh make_mesh(const arb::morphology&, size_t n_faces, float scale, task_progress* progress=nullptr);
+
 // TODO Split this into rendering and actual geometry. ATM these are coupled in `get_object_id` via the `id_to_*` tables.
 struct geometry {
   geometry();
@@ -81,10 +99,17 @@ struct geometry {
   void make_marker(const std::vector<glm::vec3>& points, renderable&);
   void make_region(const std::vector<arb::msegment>& segments, renderable&);
   void make_iexpr(const iexpr_info& expr, renderable&);
+  // Colour the mesh by a recording with one value per cable; `segment_cables` as
+  // from `cell_builder::make_cable_map`; uncovered segments show the lowest value.
+  // Afterwards, only `set_playback` is needed per frame, which uploads `n_cables`
+  // floats and leaves the mesh alone.
+  void make_playback(const std::vector<std::pair<unsigned, unsigned>>& segment_cables, size_t n_cables);
+  void set_playback(const float* values, float lo, float hi);
   void make_ruler();
   std::optional<object_id> get_id();
   void clear();
   void load_geometry(const arb::morphology&, bool=false);
+  void load_mesh(mesh&&, bool=false);
 
   std::vector<arb::msegment> segments;
   std::vector<point>         vertices;
@@ -97,6 +122,11 @@ struct geometry {
   component_unique<renderable> regions;
   component_unique<renderable> iexprs;
   renderable                   cv_boundaries;
+  renderable                   playback;
+  unsigned                     playback_tbo = 0;   // One value per cable ...
+  unsigned                     playback_tex = 0;   // ... read by the shader as a buffer texture
+  size_t                       playback_size = 0;
+  float                        playback_lo = 0.0f, playback_scale = 0.0f;
 
   render_ctx pick;
   render_ctx cell;
@@ -108,6 +138,7 @@ struct geometry {
   unsigned vbo            = 0;
   unsigned region_program = 0;
   unsigned iexpr_program  = 0;
+  unsigned playback_program = 0;
   unsigned object_program = 0;
   unsigned marker_program = 0;
 
@@ -1,20 +1,26 @@
 #pragma once
 
+#include <algorithm>
+#include <cctype>
 #include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 
 #include <fmt/format.h>
 #include <imgui.h>
 #include <misc/cpp/imgui_stdlib.h>
 
+#include "arena.hpp"
 #include "id.hpp"
 #include "icons.hpp"
 #include "utils.hpp"
 
-inline void gui_tooltip(const std::string& message) {
+inline void gui_tooltip(std::string_view message) {
     if (ImGui::IsItemHovered()) {
         ImGui::BeginTooltip();
         ImGui::PushTextWrapPos(ImGui::GetFontSize() * 35.0f);
-        ImGui::TextUnformatted(message.c_str());
+        ImGui::TextUnformatted(message.data(), message.data() + message.size());
         ImGui::PopTextWrapPos();
         ImGui::EndTooltip();
     }
@@ -32,22 +38,24 @@ inline void gui_check_state(const T& def) {
 
 inline void gui_right_margin(float delta=40.0f) { ImGui::SameLine(ImGui::GetWindowWidth() - delta); }
 
-inline bool gui_tree(const std::string& label, bool& force) {
+inline bool gui_tree(const char* label, bool& force) {
     if (force) {
         ImGui::SetNextItemOpen(force);
         force = false;
     }
     ImGui::AlignTextToFramePadding();
-    return ImGui::TreeNodeEx(label.c_str(), ImGuiTreeNodeFlags_AllowItemOverlap);
+    return ImGui::TreeNodeEx(label, ImGuiTreeNodeFlags_AllowItemOverlap);
 }
 
-inline bool gui_tree(const std::string& label) {
+inline bool gui_tree(const char* label) {
     ImGui::AlignTextToFramePadding();
-    return ImGui::TreeNodeEx(label.c_str(), ImGuiTreeNodeFlags_AllowItemOverlap);
+    return ImGui::TreeNodeEx(label, ImGuiTreeNodeFlags_AllowItemOverlap);
 }
 
+inline bool gui_tree(const std::string& label) { return gui_tree(label.c_str()); }
+
 template<typename F>
-bool gui_tree_add(const std::string& label, F action) {
+bool gui_tree_add(const char* label, F action) {
     static bool force_open = false;
     auto open = gui_tree(label, force_open);
     gui_right_margin();
@@ -58,6 +66,9 @@ bool gui_tree_add(const std::string& label, F action) {
     return open;
 }
 
+template<typename F>
+bool gui_tree_add(const std::string& label, F action) { return gui_tree_add(label.c_str(), action); }
+
 struct with_item_width {
     with_item_width(float px) { ImGui::PushItemWidth(px); }
     ~with_item_width() { ImGui::PopItemWidth(); }
@@ -84,50 +95,90 @@ struct with_id {
     ~with_id() { ImGui::PopID(); }
 };
 
-inline bool gui_select(const std::string& item, std::string& current) {
-    if (ImGui::Selectable(item.c_str(), item == current)) {
+// Search box, its text is kept per ID scope.
+inline const std::string& gui_search(const char* hint="Filter") {
+    static std::unordered_map<ImGuiID, std::string> needles;
+    auto& needle = needles[ImGui::GetID("##search")];
+    ImGui::SetNextItemWidth(-1.0f);
+    ImGui::InputTextWithHint("##search", frame_format("{} {}", icon_search, hint), &needle);
+    return needle;
+}
+
+// Case-insensitive substring match, everything matches an empty needle.
+inline bool gui_matches(const std::string& text, const std::string& needle) {
+    auto eq = [](char a, char b) { return std::tolower((unsigned char) a) == std::tolower((unsigned char) b); };
+    return std::search(text.begin(), text.end(), needle.begin(), needle.end(), eq) != text.end();
+}
+
+// Submit a row only if it might be visible, otherwise leave a gap of the
+// height it had when last drawn. Call within the row's ID scope.
+template<typename F>
+inline void gui_lazy_row(F&& draw) {
+    auto storage = ImGui::GetStateStorage();
+    auto key     = ImGui::GetID("##row-height");
+    auto height  = storage->GetFloat(key, -1.0f);
+    if (height > 0.0f && !ImGui::IsRectVisible({1.0f, height})) {
+        ImGui::Dummy({1.0f, height});
+        return;
+    }
+    auto beg = ImGui::GetCursorPosY();
+    draw();
+    storage->SetFloat(key, ImGui::GetCursorPosY() - beg - ImGui::GetStyle().ItemSpacing.y);
+}
+
+inline bool gui_select(const char* item, std::string& current) {
+    if (ImGui::Selectable(item, item == current)) {
         current = item;
         return true;
     }
     return false;
 }
 
+inline bool gui_select(const std::string& item, std::string& current) { return gui_select(item.c_str(), current); }
+
 template<typename Container>
-inline void gui_choose(const std::string& lbl, std::string& current, const Container& items) {
-    if (ImGui::BeginCombo(lbl.c_str(), current.c_str())) {
+inline void gui_choose(const char* lbl, std::string& current, const Container& items) {
+    if (ImGui::BeginCombo(lbl, current.c_str())) {
         for (const auto& item: items) gui_select(item, current);
         ImGui::EndCombo();
     }
 }
 
-inline bool gui_input_double(const std::string& lbl, double& v, const std::string& unit="", const std::string& fmt="%8g") {
-    auto format = fmt;
-    if (!unit.empty()) format += " " + unit;
-    return ImGui::InputDouble(lbl.c_str(), &v, 0.0, 0.0, format.c_str(), ImGuiInputTextFlags_CharsScientific);
+inline const char* gui_unit_format(const char* unit, const char* fmt) {
+    return *unit ? frame_format("{} {}", fmt, unit) : fmt;
 }
 
-inline bool gui_input_double(const std::string& lbl, std::optional<double>& v, const std::string& unit="", const std::string& fmt="%8g") {
-    auto format = fmt;
-    if (!unit.empty()) format += " " + unit;
+inline bool gui_input_double(const char* lbl, double& v, const char* unit="", const char* fmt="%8g") {
+    return ImGui::InputDouble(lbl, &v, 0.0, 0.0, gui_unit_format(unit, fmt), ImGuiInputTextFlags_CharsScientific);
+}
+
+inline bool gui_input_double(const char* lbl, std::optional<double>& v, const char* unit="", const char* fmt="%8g") {
     double tmp;
     if (v) tmp = v.value();
-    auto result = ImGui::InputDouble(lbl.c_str(), &tmp, 0.0, 0.0, format.c_str(), ImGuiInputTextFlags_CharsScientific);
+    auto result = ImGui::InputDouble(lbl, &tmp, 0.0, 0.0, gui_unit_format(unit, fmt), ImGuiInputTextFlags_CharsScientific);
     if (result) v = tmp;
     return result;
 }
 
+inline bool gui_input_double(const std::string& lbl, double& v) { return gui_input_double(lbl.c_str(), v); }
 
-inline void gui_defaulted_double(const std::string& label, const std::string& unit, std::optional<double>& value, const double fallback) {
+
+inline bool gui_defaulted_double(const char* label, const char* unit, std::optional<double>& value, const double fallback) {
     auto tmp = value.value_or(fallback);
-    if (gui_input_double(label, tmp, unit)) value = {tmp};
+    auto changed = gui_input_double(label, tmp, unit);
+    if (changed) value = {tmp};
     gui_right_margin();
-    if (ImGui::Button(icon_refresh)) value = {};
+    if (ImGui::Button(icon_refresh)) {
+        value   = {};
+        changed = true;
+    }
     gui_tooltip("Reset to default");
+    return changed;
 }
 
 inline auto
-gui_defaulted_double(const std::string& label,
-                     const std::string& unit,
+gui_defaulted_double(const char* label,
+                     const char* unit,
                      std::optional<double>& value,
                      const std::optional<double>& fallback) {
     if (fallback) return gui_defaulted_double(label, unit, value, fallback.value());
@@ -135,8 +186,8 @@ gui_defaulted_double(const std::string& label,
 }
 
 inline auto
-gui_defaulted_double(const std::string& label,
-                          const std::string& unit,
+gui_defaulted_double(const char* label,
+                          const char* unit,
                           std::optional<double>& value,
                           const std::optional<double>& fallback,
                           const std::optional<double>& fallback2) {
@@ -153,5 +204,5 @@ inline bool gui_toggle(const char *on, const char *off, bool& flag) {
     return false;
 }
 
-inline bool gui_menu_item(const char* text, const char* icon) { return ImGui::MenuItem(fmt::format("{} {}", icon, text).c_str()); }
-inline bool gui_menu_item(const char* text, const char* icon, const char* key) { return ImGui::MenuItem(fmt::format("{} {}", icon, text).c_str(), key); }
+inline bool gui_menu_item(const char* text, const char* icon) { return ImGui::MenuItem(frame_format("{} {}", icon, text)); }
+inline bool gui_menu_item(const char* text, const char* icon, const char* key) { return ImGui::MenuItem(frame_format("{} {}", icon, text), key); }
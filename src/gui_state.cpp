@@ -1,7 +1,10 @@
 #include "gui_state.hpp"
 
 #include <cmath>
+#include <limits>
 #include <string>
+#include <utility>
+#include <variant>
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -32,6 +35,7 @@
 #include "loader.hpp"
 #include "config.hpp"
 #include "recipe.hpp"
+#include "trace_export.hpp"
 
 extern float delta_zoom;
 extern glm::vec2 mouse;
@@ -40,6 +44,112 @@ using namespace std::literals;
 namespace U = arb::units;
 
 namespace {
+  const std::vector<std::string> load_stages{"Parsing", "Morphology", "Mesh", "Labels"};
+  // Probe tag of the cell-wide recording
+  const std::string cell_tag = "cell-wide";
+
+  // Split 'cat::mech::state' into the mechanism as named in the merged catalogue and the state.
+  std::pair<std::string, std::string> split_state_variable(const std::string& var) {
+    auto sep = var.rfind("::");
+    if (sep == std::string::npos) log_error("State variable '{}' is not of the form 'cat::mech::state'", var);
+    return {var.substr(0, sep), var.substr(sep + 2)};
+  }
+  // Quiet time after the last keystroke before labels are concretised.
+  constexpr auto label_debounce = 250ms;
+
+  // Build builder, mesh, and concrete labels; runs on the loader's worker.
+  prepared_morphology prepare_morphology(const io::loaded_morphology& loaded, size_t n_faces, float scale, task_progress& progress) {
+    prepared_morphology result;
+    progress.enter(1);
+    result.builder = cell_builder{loaded.morph};
+    progress.enter(2);
+    result.cell_mesh = make_mesh(loaded.morph, n_faces, scale, &progress);
+    progress.enter(3);
+    for (const auto& [k, v]: loaded.regions) result.regions.emplace_back(k, v);
+    for (const auto& [k, v]: loaded.locsets) result.locsets.emplace_back(k, v);
+    for (const auto& [k, v]: loaded.iexprs)  result.iexprs.emplace_back(k, v);
+    auto& builder = result.builder;
+    builder.make_label_dict(result.locsets, result.regions, result.iexprs);
+    progress.advance(1, 4);
+    result.region_segments = builder.make_segments(to_pointers(result.regions));
+    progress.advance(2, 4);
+    result.locset_points = builder.make_points(to_pointers(result.locsets));
+    progress.advance(3, 4);
+    builder.make_iexprs(to_pointers(result.iexprs));
+    return result;
+  }
+
+  // Concretise labels against `builder`, return the given labels plus all
+  // labels re-evaluated along with them. Unknown ids are skipped.
+  label_update evaluate_labels(cell_builder& builder,
+                               component_unique<rg_def>& region_defs,
+                               component_unique<ls_def>& locset_defs,
+                               component_unique<ie_def>& iexpr_defs,
+                               const std::vector<id_type>& regions,
+                               const std::vector<id_type>& locsets,
+                               const std::vector<id_type>& iexprs) {
+    auto dirty = builder.make_label_dict(locset_defs.items, region_defs.items, iexpr_defs.items);
+    auto collect = [&](const auto& ids, auto& defs, label_kind kind) {
+      std::vector<id_type> result;
+      std::unordered_set<id_type> seen;
+      for (const auto& id: ids) {
+        if (defs.contains(id) && seen.insert(id).second) result.push_back(id);
+      }
+      for (const auto& id: defs.idx_to_parent) {
+        if (!seen.contains(id) && dirty.contains({kind, defs[id].name})) result.push_back(id);
+      }
+      return result;
+    };
+    label_update result;
+    result.regions = collect(regions, region_defs, label_kind::region);
+    result.locsets = collect(locsets, locset_defs, label_kind::locset);
+    result.iexprs  = collect(iexprs,  iexpr_defs,  label_kind::iexpr);
+
+    std::vector<rg_def*> rgs;
+    std::vector<ls_def*> lss;
+    std::vector<ie_def*> ies;
+    for (const auto& id: result.regions) rgs.push_back(&region_defs[id]);
+    for (const auto& id: result.locsets) lss.push_back(&locset_defs[id]);
+    for (const auto& id: result.iexprs)  ies.push_back(&iexpr_defs[id]);
+    result.region_segments = builder.make_segments(rgs);
+    result.locset_points   = builder.make_points(lss);
+    builder.make_iexprs(ies);
+    return result;
+  }
+
+  // Label definitions for a worker; iexprs without the values rendered for them.
+  template<typename Def>
+  component_unique<Def> label_inputs(const component_unique<Def>& defs) { return defs; }
+
+  component_unique<ie_def> label_inputs(const component_unique<ie_def>& defs) {
+    component_unique<ie_def> result;
+    result.idx_to_parent = defs.idx_to_parent;
+    result.sparse        = defs.sparse;
+    result.items.reserve(defs.items.size());
+    for (const auto& def: defs.items) {
+      auto& copy = result.items.emplace_back(def.name, "");
+      copy.definition = def.definition;
+      copy.data       = def.data;
+      copy.state      = def.state;
+      copy.message    = def.message;
+    }
+    return result;
+  }
+
+  // Take over the outcome of a worker's evaluation, by id.
+  template<typename Def>
+  void apply_label_results(component_unique<Def>& defs, const component_unique<Def>& results) {
+    for (auto ix = 0ul; ix < results.items.size(); ++ix) {
+      const auto& id = results.idx_to_parent[ix];
+      if (!defs.contains(id)) continue;
+      auto& def       = defs[id];
+      const auto& res = results.items[ix];
+      def.data    = res.data;
+      def.state   = res.state;
+      def.message = res.message;
+    }
+  }
+
   inline void gui_read_morphology(gui_state& state, bool& open);
   inline void gui_debug(bool&);
   inline void gui_style(bool&);
@@ -139,7 +249,7 @@ namespace {
     with_id id{"loading cat"};
     ImGui::OpenPopup("Load");
     static std::vector<std::string> suffixes{".so"};
-    static std::string loader_error = "";
+    static bool requested = false;
     if (ImGui::BeginPopupModal("Load")) {
       gui_dir_view(state.cat_chooser);
       {
@@ -155,7 +265,10 @@ namespace {
         ImGui::SameLine();
         ImGui::InputText("Name", &state.open_cat_name);
       }
-      auto can_load = !state.open_cat_name.empty() && !catalogues.contains(state.open_cat_name);
+      ImGui::SameLine();
+      ImGui::Checkbox("Watch", &state.watch_cat);
+      gui_tooltip("Reload when the file changes.");
+      auto can_load = !state.open_cat_name.empty() && !catalogues.contains(state.open_cat_name) && !state.loading_cat;
       ImGui::PushStyleVar(ImGuiStyleVar_Alpha, can_load ? 1.0f: 0.6f);
       auto ok = ImGui::Button("Load");
       ImGui::PopStyleVar();
@@ -167,34 +280,41 @@ namespace {
       auto ko = ImGui::Button("Cancel");
 
       if (ok && can_load) {
-        try {
-          log_debug("Adding catalogue '{}'", state.open_cat_name);
-          auto cat = arb::load_catalogue(state.cat_chooser.file.string());
-          catalogues[state.open_cat_name] = cat;
-          open = false;
-        } catch (const arb::arbor_exception& e) {
-          log_debug("Failed to load catalogue: {}", e.what());
-          loader_error = e.what();
-        }
+        log_debug("Adding catalogue '{}'", state.open_cat_name);
+        state.catalogue_error.clear();
+        state.start_load_catalogue(state.open_cat_name, state.cat_chooser.file);
+        requested = true;
+      }
+      if (state.loading_cat) {
+        auto& progress = state.loading_cat->progress();
+        ImGui::ProgressBar(progress.total(), {-1.0f, 0.0f}, progress.label().c_str());
+      } else if (requested) {
+        // Result was taken up by `poll_catalogues`
+        requested = false;
+        if (state.catalogue_error.empty()) open = false;
       }
 
-      if (!loader_error.empty()) {
+      if (!state.catalogue_error.empty()) {
         ImGui::SetNextWindowSize(ImVec2(ImGui::GetFontSize() * 40.0f, ImGui::GetFontSize() * 5.0f));
         ImGui::OpenPopup("Cannot Open Mechanism Catalogue");
       }
 
       if (ImGui::BeginPopupModal("Cannot Open Mechanism Catalogue")) {
         ImGui::PushTextWrapPos(ImGui::GetFontSize() * 50.0f);
-        ImGui::TextUnformatted(loader_error.c_str());
+        ImGui::TextUnformatted(state.catalogue_error.c_str());
         ImGui::PopTextWrapPos();
         if (ImGui::Button("Close")) {
-          loader_error.clear();
+          state.catalogue_error.clear();
           ImGui::CloseCurrentPopup();
         }
         ImGui::EndPopup();
       }
 
-      if (ko) open = false;
+      if (ko) {
+        if (state.loading_cat) state.loading_cat->cancel();
+        requested = false;
+        open = false;
+      }
       ImGui::EndPopup();
     }
   }
@@ -222,8 +342,14 @@ namespace {
         if(gui_menu_item("Load##cat",  icon_load)) {
           state.open_cat_read = true;
           state.open_cat_name = ""; // Reset name;
+          state.catalogue_error.clear();
+        }
+        if (gui_menu_item("Reset##cat", icon_clean)) {
+          if (state.loading_cat) state.loading_cat->cancel();
+          state.loading_cat.reset();
+          state.catalogue_sources.clear();
+          reset_catalogues();
         }
-        if (gui_menu_item("Reset##cat", icon_clean)) catalogues = default_catalogues;
       }
       ImGui::Separator();
       state.shutdown_requested = gui_menu_item("Quit", "");
@@ -334,20 +460,36 @@ namespace {
         ImGui::Text("%s", loader.load ? icon_ok : icon_error);
         gui_tooltip(loader.message);
         ImGui::SameLine();
-        if (ImGui::Button("Cancel")) open_file = false;
+        if (ImGui::Button("Cancel")) {
+          // First cancel a running load, then the dialog
+          if (state.loading) {
+            state.loading->cancel();
+            state.loading.reset();
+          } else {
+            open_file = false;
+          }
+        }
         {
           static std::string loader_error = "";
-          if (do_load && loader.load) {
-            try {
-              auto result = loader.load.value()(state.file_chooser.file);
-              state.reload(result);
-              open_file = false;
-            } catch (const arborio::swc_error& e) {
-              loader_error = e.what();
-            } catch (const arborio::neuroml_exception& e) {
-              loader_error = e.what();
-            } catch (const std::runtime_error& e) {
-              loader_error = e.what();
+          if (do_load && loader.load && !state.loading) state.start_load(state.file_chooser.file, loader.load.value());
+          if (state.loading) {
+            auto& progress = state.loading->progress();
+            ImGui::ProgressBar(progress.total(), {-1.0f, 0.0f}, progress.label().c_str());
+            if (state.loading->ready()) {
+              try {
+                state.finish_load(state.loading->get());
+                open_file = false;
+              } catch (const task_cancelled&) {
+              } catch (const arborio::swc_error& e) {
+                loader_error = e.what();
+              } catch (const arborio::neuroml_exception& e) {
+                loader_error = e.what();
+              } catch (const arb::arbor_exception& e) {
+                loader_error = e.what();
+              } catch (const std::runtime_error& e) {
+                loader_error = e.what();
+              }
+              state.loading.reset();
             }
           }
           if (ImGui::BeginPopupModal("Cannot Load Morphology")) {
@@ -373,7 +515,7 @@ namespace {
   inline bool gui_axes(axes& ax) {
     ImGui::Text("%s Axes", icon_axes);
     gui_right_margin();
-    gui_toggle(fmt::format("{}##{}", icon_on, "ax").c_str(), fmt::format("{}##{}", icon_off, "ax").c_str(), ax.active);
+    gui_toggle(frame_format("{}##{}", icon_on, "ax"), frame_format("{}##{}", icon_off, "ax"), ax.active);
     auto mv = ImGui::InputFloat3("Position", &ax.origin[0]);
     auto sz = ImGui::InputFloat("Size", &ax.scale, 0, 0, "%f µm");
     return mv || sz;
@@ -399,15 +541,15 @@ namespace {
             ImGui::EndCombo();
           }
         }
-        if (ImGui::BeginMenu(fmt::format("{} Snap", icon_locset).c_str())) {
+        if (ImGui::BeginMenu(frame_format("{} Snap", icon_locset))) {
           for (const auto& id: state.locsets) {
             const auto& ls = state.locset_defs[id];
             if (ls.state != def_state::good) continue;
-            if (ImGui::BeginMenu(fmt::format("{} {}", icon_locset, ls.name).c_str())) {
+            if (ImGui::BeginMenu(frame_format("{} {}", icon_locset, ls.name))) {
               auto points = state.builder.make_points(ls.data.value());
               for (const auto& point: points) {
-                const auto lbl = fmt::format("({: 7.3f} {: 7.3f} {: 7.3f})", point.x, point.y, point.z);
-                if (ImGui::MenuItem(lbl.c_str())) {
+                const auto lbl = frame_format("({: 7.3f} {: 7.3f} {: 7.3f})", point.x, point.y, point.z);
+                if (ImGui::MenuItem(lbl)) {
                   state.view.offset = {0.0, 0.0};
                   state.view.target = point;
                 }
@@ -520,9 +662,9 @@ namespace {
     {
       with_indent indent;
       for (const auto& iex: state.iexpr_defs.items) {
-        if (iex.state == def_state::good) {
-          auto& info = iex.info;
-          const auto& [pv, dv] = info.values.at(object.data.id);
+        const auto& info = iex.info;
+        if (iex.state == def_state::good && object.data.id < info.values.size()) {
+          const auto& [pv, dv] = info.values[object.data.id];
           ImGui::BulletText("%s: %f -- %f", iex.name.c_str(), pv, dv);
         }
       }
@@ -530,7 +672,7 @@ namespace {
     ImGui::BulletText("Regions");
     {
       with_indent indent;
-      for (const auto& region: state.segment_to_regions[object.data.id]) {
+      for (const auto& region: state.region_members.regions_at(object.data.id)) {
         ImGui::ColorButton("", to_imvec(state.renderer.regions[region].color));
         ImGui::SameLine();
         ImGui::AlignTextToFramePadding();
@@ -539,19 +681,35 @@ namespace {
     }
   }
 
+  inline void gui_region_overlaps(gui_state& state) {
+    if (!ImGui::CollapsingHeader("Region Overlaps")) return;
+    with_indent indent;
+    const auto& overlaps = state.region_members.overlaps();
+    if (overlaps.empty()) ImGui::TextDisabled("None.");
+    for (const auto& [a, b, n]: overlaps) {
+      ImGui::ColorButton("", to_imvec(state.renderer.regions[a].color));
+      ImGui::SameLine();
+      ImGui::ColorButton("", to_imvec(state.renderer.regions[b].color));
+      ImGui::SameLine();
+      ImGui::AlignTextToFramePadding();
+      ImGui::Text("%s & %s: %zu segments", state.region_defs[a].name.c_str(), state.region_defs[b].name.c_str(), n);
+    }
+  }
+
   inline void gui_cell_info(gui_state& state) {
-    if (ImGui::Begin(fmt::format("{} Morphology##info", icon_branch).c_str())) {
+    if (ImGui::Begin(frame_format("{} Morphology##info", icon_branch))) {
       if (state.object) gui_morph_info(state);
     }
     ImGui::End();
-    if (ImGui::Begin(fmt::format("{} Locations##info", icon_location).c_str())) {
+    if (ImGui::Begin(frame_format("{} Locations##info", icon_location))) {
       if (state.object) gui_loc_info(state);
+      gui_region_overlaps(state);
     }
     ImGui::End();
   }
 
   template<typename Item>
-  inline void gui_locdefs(const std::string& name,
+  inline void gui_locdefs(const char* name,
                           entity& ids,
                           component_unique<Item>& items,
                           component_unique<renderable>& renderables,
@@ -562,54 +720,58 @@ namespace {
     auto open = gui_tree_add(name, [&](){ events.emplace_back(evt_add_locdef<Item>{}); });
     if (open) {
       with_item_width iw(120.0f);
-      auto ix = 0;
+      const auto& needle = gui_search();
+      auto ix = -1;
       for (const auto& id: ids) {
+        ix++;
+        auto& item = items[id];
+        if (!gui_matches(item.name, needle)) continue;
         with_id guard{id};
-        auto& render = renderables[id];
-        auto& item   = items[id];
-        auto open    = gui_tree("");
-        ImGui::SameLine();
-        auto beg = ImGui::GetCursorPos();
-        if (ImGui::InputText("##locdef-name", &item.name, ImGuiInputTextFlags_AutoSelectAll)) events.push_back(evt_upd_locdef<Item>{id});
-        if (show_color) {
+        gui_lazy_row([&]() {
+          auto& render = renderables[id];
+          auto open    = gui_tree("");
           ImGui::SameLine();
-          ImGui::ColorEdit3("##locdef-color", &render.color.x, ImGuiColorEditFlags_NoInputs | ImGuiColorEditFlags_NoLabel);
-        }
-        ImGui::SameLine();
-        gui_toggle(icon_show, icon_hide, render.active);
-        ImGui::SameLine();
-        if (ImGui::Button(icon_clone)) events.push_back(evt_add_locdef<Item>{item.name, item.definition});
-        ImGui::SameLine();
-        gui_check_state(item);
-        gui_right_margin();
-        if (ImGui::Button(icon_delete)) events.push_back(evt_del_locdef<Item>{id});
-
-        if (open) {
-          with_item_width iw(-50.0f);
-          auto indent = gui_tree_indent();
-          ImGui::PushTextWrapPos(ImGui::GetFontSize() * 50.0f);
-          if (ImGui::InputTextMultiline("##locdef-definition", &item.definition)) events.push_back(evt_upd_locdef<Item>{id});
-          ImGui::PopTextWrapPos();
-          ImGui::TreePop();
-        }
-        auto end = ImGui::GetCursorPos();
-        ImGui::SetCursorPos(beg);
-        ImGui::InvisibleButton("drag area", ImVec2(ImGui::GetContentRegionAvail().x, end.y - beg.y));
-        if (ImGui::BeginDragDropSource(ImGuiDragDropFlags_SourceNoHoldToOpenOthers)) {
-          ImGui::Text("%s", item.name.c_str());
-          ImGui::SetDragDropPayload(name.c_str(), &ix, sizeof(ix));
-          ImGui::EndDragDropSource();
-        }
-        if (ImGui::BeginDragDropTarget()) {
-          auto data = ImGui::AcceptDragDropPayload(name.c_str(), ImGuiDragDropFlags_SourceNoHoldToOpenOthers);
-          if (data) {
-            from = *((int*) data->Data);
-            to   = ix;
+          auto beg = ImGui::GetCursorPos();
+          if (ImGui::InputText("##locdef-name", &item.name, ImGuiInputTextFlags_AutoSelectAll)) events.push_back(evt_upd_locdef<Item>{id});
+          if (show_color) {
+            ImGui::SameLine();
+            ImGui::ColorEdit3("##locdef-color", &render.color.x, ImGuiColorEditFlags_NoInputs | ImGuiColorEditFlags_NoLabel);
           }
-          ImGui::EndDragDropTarget();
-        }
-        ImGui::SetCursorPos(end);
-        ix++;
+          ImGui::SameLine();
+          gui_toggle(icon_show, icon_hide, render.active);
+          ImGui::SameLine();
+          if (ImGui::Button(icon_clone)) events.push_back(evt_add_locdef<Item>{item.name, item.definition});
+          ImGui::SameLine();
+          gui_check_state(item);
+          gui_right_margin();
+          if (ImGui::Button(icon_delete)) events.push_back(evt_del_locdef<Item>{id});
+
+          if (open) {
+            with_item_width iw(-50.0f);
+            auto indent = gui_tree_indent();
+            ImGui::PushTextWrapPos(ImGui::GetFontSize() * 50.0f);
+            if (ImGui::InputTextMultiline("##locdef-definition", &item.definition)) events.push_back(evt_upd_locdef<Item>{id});
+            ImGui::PopTextWrapPos();
+            ImGui::TreePop();
+          }
+          auto end = ImGui::GetCursorPos();
+          ImGui::SetCursorPos(beg);
+          ImGui::InvisibleButton("drag area", ImVec2(ImGui::GetContentRegionAvail().x, end.y - beg.y));
+          if (ImGui::BeginDragDropSource(ImGuiDragDropFlags_SourceNoHoldToOpenOthers)) {
+            ImGui::Text("%s", item.name.c_str());
+            ImGui::SetDragDropPayload(name, &ix, sizeof(ix));
+            ImGui::EndDragDropSource();
+          }
+          if (ImGui::BeginDragDropTarget()) {
+            auto data = ImGui::AcceptDragDropPayload(name, ImGuiDragDropFlags_SourceNoHoldToOpenOthers);
+            if (data) {
+              from = *((int*) data->Data);
+              to   = ix;
+            }
+            ImGui::EndDragDropTarget();
+          }
+          ImGui::SetCursorPos(end);
+        });
       }
       ImGui::TreePop();
     }
@@ -634,27 +796,32 @@ namespace {
   }
 
   inline void gui_locations(gui_state& state) {
-    if (ImGui::Begin(fmt::format("{} Locations", icon_location).c_str())) {
-      gui_locdefs(fmt::format("{} Regions", icon_region), state.regions, state.region_defs, state.renderer.regions, state.events);
+    if (ImGui::Begin(frame_format("{} Locations", icon_location))) {
+      gui_locdefs(frame_format("{} Regions", icon_region), state.regions, state.region_defs, state.renderer.regions, state.events);
       ImGui::Separator();
-      gui_locdefs(fmt::format("{} Locsets", icon_locset), state.locsets, state.locset_defs, state.renderer.locsets, state.events);
+      gui_locdefs(frame_format("{} Locsets", icon_locset), state.locsets, state.locset_defs, state.renderer.locsets, state.events);
       ImGui::Separator();
-      gui_locdefs(fmt::format("{} Inhomogeneous", icon_iexpr), state.iexprs, state.iexpr_defs, state.renderer.iexprs, state.events, false);
+      gui_locdefs(frame_format("{} Inhomogeneous", icon_iexpr), state.iexprs, state.iexpr_defs, state.renderer.iexprs, state.events, false);
     }
     ImGui::End(); // locations
   }
 
   inline void gui_ion_settings(gui_state& state) {
     with_id guard{"ion-settings"};
-    if (gui_tree(fmt::format("{} Regions", icon_region))) {
+    if (gui_tree(frame_format("{} Regions", icon_region))) {
+      const auto& needle = gui_search();
       for (const auto& region: state.regions) {
+        const auto& name = state.region_defs[region].name;
+        if (!gui_matches(name, needle)) continue;
         with_id guard{region.value};
-        if (gui_tree(state.region_defs[region].name)) {
-          for (const auto& ion: state.ions) {
-            gui_ion_parameter(ion, state.ion_defs[ion], state.ion_par_defs[{region, ion}], state.ion_defaults[ion], state.presets.ion_data);
+        gui_lazy_row([&]() {
+          if (gui_tree(name)) {
+            for (const auto& ion: state.ions) {
+              gui_ion_parameter(ion, state.ion_defs[ion], state.ion_par_defs[{region, ion}], state.ion_defaults[ion], state.presets.ion_data);
+            }
+            ImGui::TreePop();
           }
-          ImGui::TreePop();
-        }
+        });
       }
       ImGui::TreePop();
     }
@@ -662,7 +829,7 @@ namespace {
 
   inline void gui_ion_defaults(gui_state& state) {
     with_id guard{"ion-defaults"};
-    auto open = gui_tree_add(fmt::format("{} Default", icon_default), [&]() { state.add_ion(); });
+    auto open = gui_tree_add(frame_format("{} Default", icon_default), [&]() { state.add_ion(); });
     if (open) {
       for (const auto& ion: state.ions) {
         gui_ion_default(ion, state.ion_defs[ion], state.ion_defaults[ion], state.presets.ion_data, state.events);
@@ -672,18 +839,22 @@ namespace {
   }
 
   inline void gui_mechanisms(gui_state& state) {
-    if (gui_tree(fmt::format("{} Mechanisms", icon_gears))) {
+    if (gui_tree(frame_format("{} Mechanisms", icon_gears))) {
+      const auto& needle = gui_search();
       for (const auto& region: state.regions) {
+        const auto& name = state.region_defs[region].name;
+        if (!gui_matches(name, needle)) continue;
         with_id region_guard{region.value};
-        auto name = state.region_defs[region].name;
-        auto open = gui_tree_add(name, [&]() { state.add_mechanism(region); });
-        if (open) {
-          with_item_width width{120.0f};
-          for (const auto& child: state.mechanisms.get_children(region)) {
-            gui_mechanism(child, state.mechanisms[child], state.iexpr_defs.items, state.events);
+        gui_lazy_row([&]() {
+          auto open = gui_tree_add(name, [&]() { state.add_mechanism(region); });
+          if (open) {
+            with_item_width width{120.0f};
+            for (const auto& child: state.mechanisms.get_children(region)) {
+              gui_mechanism(child, state.mechanisms[child], state.iexpr_defs.items, state.events);
+            }
+            ImGui::TreePop();
           }
-          ImGui::TreePop();
-        }
+        });
       }
       ImGui::TreePop();
     }
@@ -691,27 +862,32 @@ namespace {
 
   inline void gui_parameters(gui_state& state) {
     with_id id{"parameters"};
-    if (ImGui::Begin(fmt::format("{} Parameters", icon_list).c_str())) {
-      if (gui_tree(fmt::format("{} Cable Cell Properties", icon_sliders))) {
+    if (ImGui::Begin(frame_format("{} Parameters", icon_list))) {
+      if (gui_tree(frame_format("{} Cable Cell Properties", icon_sliders))) {
         with_id id{"properties"};
-        if (gui_tree(fmt::format("{} Default", icon_default))) {
-          gui_parameter_defaults(state.parameter_defaults, state.presets);
+        if (gui_tree(frame_format("{} Default", icon_default))) {
+          if (gui_parameter_defaults(state.parameter_defaults, state.presets)) ++state.cv_parameter_version;
           ImGui::TreePop();
         }
-        if (gui_tree(fmt::format("{} Regions", icon_region))) {
+        if (gui_tree(frame_format("{} Regions", icon_region))) {
+          const auto& needle = gui_search();
           for (const auto& region: state.regions) {
+            const auto& name = state.region_defs[region].name;
+            if (!gui_matches(name, needle)) continue;
             with_id id{region};
-            if (gui_tree(state.region_defs[region].name)) {
-              gui_parameter(state.parameter_defs[region], state.parameter_defaults, state.presets);
-              ImGui::TreePop();
-            }
+            gui_lazy_row([&]() {
+              if (gui_tree(name)) {
+                if (gui_parameter(state.parameter_defs[region], state.parameter_defaults, state.presets)) ++state.cv_parameter_version;
+                ImGui::TreePop();
+              }
+            });
           }
           ImGui::TreePop();
         }
         ImGui::TreePop();
       }
       ImGui::Separator();
-      if (gui_tree(fmt::format("{} Ion Settings", icon_ion))) {
+      if (gui_tree(frame_format("{} Ion Settings", icon_ion))) {
         with_id id{"ion-settings"};
         gui_ion_defaults(state);
         gui_ion_settings(state);
@@ -724,62 +900,61 @@ namespace {
   }
 
   inline void gui_probes(gui_state& state) {
-    auto open = gui_tree(fmt::format("{} Probes", icon_probe));
+    auto open = gui_tree(frame_format("{} Probes", icon_probe));
     if (open) {
-      // Ion names
-      std::vector<std::string> ion_names;
-      for (const auto& ion: state.ions) ion_names.push_back(state.ion_defs[ion].name);
-
-      // Mech Variables
-      std::vector<std::string> state_vars;
-      for (const auto& [name, cat]: catalogues) {
-        for (const auto& mech: cat.mechanism_names()) {
-          const auto& info = cat[mech];
-          for (const auto& [k, v]: info.state) {
-            state_vars.push_back(fmt::format("{}::{}::{}", name, mech, k));
-          }
-        }
-      }
-      {
-        std::sort(state_vars.begin(), state_vars.end());
-        auto last = std::unique(state_vars.begin(), state_vars.end());
-        state_vars.erase(last, state_vars.end());
-      }
+      const auto& ion_names  = state.ion_names;
+      const auto& state_vars = catalogue_meta().state_vars;
 
+      const auto& needle = gui_search();
       for (const auto& locset: state.locsets) {
+        const auto& name = state.locset_defs[locset].name;
+        if (!gui_matches(name, needle)) continue;
         with_id id{locset};
-        auto name = state.locset_defs[locset].name;
-        auto open = gui_tree_add(fmt::format("{} {}", icon_locset, name), [&](){ state.add_probe(locset); });
-        if (open) {
-          for (const auto& probe: state.probes.get_children(locset)) {
-            gui_probe(probe, state.probes[probe], state.events, ion_names, state_vars);
+        gui_lazy_row([&]() {
+          auto open = gui_tree_add(frame_format("{} {}", icon_locset, name), [&](){ state.add_probe(locset); });
+          if (open) {
+            for (const auto& probe: state.probes.get_children(locset)) {
+              gui_probe(probe, state.probes[probe], state.events, ion_names, state_vars);
+            }
+            ImGui::TreePop();
           }
-          ImGui::TreePop();
-        }
+        });
       }
       ImGui::TreePop();
     }
   }
 
   inline void gui_detectors(gui_state& state) {
-    if (gui_tree(fmt::format("{} Spike Detectors", icon_detector))) {
+    if (gui_tree(frame_format("{} Spike Detectors", icon_detector))) {
+      const auto& needle = gui_search();
       for (const auto& ls: state.locsets) {
+        const auto& name = state.locset_defs[ls].name;
+        if (!gui_matches(name, needle)) continue;
         with_id id{ls};
-        auto name = state.locset_defs[ls].name;
-        auto open = gui_tree_add(fmt::format("{} {}", icon_locset, name),
-                                 [&](){ state.add_detector(ls); });
-        if (open) {
-          for (const auto& d: state.detectors.get_children(ls)) {
-            gui_detector(d, state.detectors[d], state.events);
+        gui_lazy_row([&]() {
+          auto open = gui_tree_add(frame_format("{} {}", icon_locset, name),
+                                   [&](){ state.add_detector(ls); });
+          if (open) {
+            for (const auto& d: state.detectors.get_children(ls)) {
+              gui_detector(d, state.detectors[d], state.events);
+            }
+            ImGui::TreePop();
           }
-          ImGui::TreePop();
-        }
+        });
       }
       ImGui::TreePop();
     }
   }
 
-  inline void gui_debug(bool& open) {  ImGui::ShowMetricsWindow(&open); }
+  inline void gui_debug(bool& open) {
+    ImGui::ShowMetricsWindow(&open);
+    if (ImGui::Begin("Frame Memory", &open)) {
+      const auto& arena = frame_strings;
+      ImGui::Text("Heap allocations last frame: %zu", arena.last_allocations);
+      ImGui::Text("Frame arena: %zu of %zu bytes", arena.last_bytes, arena.capacity());
+    }
+    ImGui::End();
+  }
 
   inline void gui_style(bool& open) {
     if (ImGui::Begin("Style", &open)) ImGui::ShowStyleEditor();
@@ -801,29 +976,51 @@ namespace {
   }
 
   inline void gui_stimuli(gui_state& state) {
-    std::vector<float> values(state.sim.until/state.sim.dt, 0.0f);
-    if (gui_tree(fmt::format("{} Stimuli", icon_stimulus))) {
+    // Scratch space for plotting envelopes, kept to avoid reallocating every frame.
+    static std::vector<float> values;
+    values.assign(state.sim.until/state.sim.dt, 0.0f);
+    if (gui_tree(frame_format("{} Stimuli", icon_stimulus))) {
+      const auto& needle = gui_search();
       for (const auto& locset: state.locsets) {
+        const auto& name = state.locset_defs[locset].name;
+        if (!gui_matches(name, needle)) continue;
         with_id id{locset};
-        auto name = state.locset_defs[locset].name;
-        auto open = gui_tree_add(fmt::format("{} {}", icon_locset, name), [&](){ state.add_stimulus(locset); });
-        if (open) {
-          for (const auto& stim: state.stimuli.get_children(locset)) {
-            gui_stimulus(stim, state.stimuli[stim], state.events, values, state.sim.dt, state.sim.until);
+        gui_lazy_row([&]() {
+          auto open = gui_tree_add(frame_format("{} {}", icon_locset, name), [&](){ state.add_stimulus(locset); });
+          if (open) {
+            for (const auto& stim: state.stimuli.get_children(locset)) {
+              gui_stimulus(stim, state.stimuli[stim], state.events, values, state.sim.dt, state.sim.until);
+            }
+            ImGui::TreePop();
           }
-          ImGui::TreePop();
-        }
+        });
       }
       ImGui::TreePop();
     }
   }
 
   inline void gui_simulation(gui_state& state) {
-    if (ImGui::Begin(fmt::format("{} Simulation", icon_sim).c_str())) {
+    if (ImGui::Begin(frame_format("{} Simulation", icon_sim))) {
       ImGui::Separator();
-      gui_sim(state.sim);
+      gui_sim(state.sim, state.ion_names, catalogue_meta().state_vars);
       ImGui::Separator();
-      gui_cv_policy(state.cv_policy_def, state.renderer.cv_boundaries, state.events);
+      {
+        auto it = state.discretisations.find(state.shown_cv_key);
+        const auto* cvs = it == state.discretisations.end() ? nullptr : &it->second;
+        gui_cv_policy(state.cv_policy_def, state.renderer.cv_boundaries, state.events, cvs);
+      }
+      gui_cv_tuner(state.tuner);
+      {
+        // At most once per frame, and only if an open panel lists them
+        std::optional<std::vector<std::pair<model_value, double>>> values;
+        model_values_fn available = [&]() -> const auto& {
+          if (!values) values = state.model_values();
+          return *values;
+        };
+        gui_fitter(state.fit, available, state.sim);
+        gui_sensitivity(state.sens, available, state.sim.trace_keys);
+        gui_ensemble(state.ens, available);
+      }
       ImGui::Separator();
       gui_stimuli(state);
       ImGui::Separator();
@@ -837,12 +1034,72 @@ namespace {
       state.run_simulation();
       state.sim.should_run = false;
     }
+    if (!state.sim.error.empty()) ImGui::OpenPopup("Error");
+    if (ImGui::BeginPopupModal("Error")) {
+      ImGui::PushTextWrapPos(ImGui::GetFontSize() * 50.0f);
+      ImGui::TextUnformatted(state.sim.error.c_str());
+      ImGui::PopTextWrapPos();
+      if (ImGui::Button("OK")) {
+        state.sim.error.clear();
+        ImGui::CloseCurrentPopup();
+      }
+      ImGui::EndPopup();
+    }
+    if (state.tuner.should_run) {
+      state.start_cv_tuning();
+      state.tuner.should_run = false;
+    }
+    if (state.tuner.apply) {
+      state.cv_policy_def.definition = std::exchange(state.tuner.apply, {}).value();
+      state.update_cv_policy();
+    }
+    if (state.fit.should_start) {
+      state.start_fitting();
+      state.fit.should_start = false;
+    }
+    if (state.fit.should_apply) {
+      try {
+        for (auto ix = 0ul; ix < std::min(state.fit.parameters.size(), state.fit.best.size()); ++ix) state.set_value(state.fit.parameters[ix].value, state.fit.best[ix]);
+      } catch (const std::exception& e) {
+        state.fit.error = e.what();
+      }
+      state.fit.should_apply = false;
+    }
+    if (state.sens.should_run) {
+      state.start_sensitivity();
+      state.sens.should_run = false;
+    }
+    if (state.ens.should_run) {
+      state.start_ensemble();
+      state.ens.should_run = false;
+    }
   }
 
-  inline arb::cable_cell make_cable_cell(gui_state& state) {
+  // What `make_decor` reads, copied so decors with other values can be made on a worker.
+  struct decor_inputs {
+    arb::cable_cell_parameter_set   presets;
+    parameter_def                   parameter_defaults;
+    entity                          locsets;
+    component_unique<ls_def>        locset_defs;
+    component_many<detector_def>    detectors;
+    component_many<stimulus_def>    stimuli;
+    entity                          regions;
+    component_unique<rg_def>        region_defs;
+    component_unique<parameter_def> parameter_defs;
+    component_many<mechanism_def>   mechanisms;
+    entity                          ions;
+    component_unique<ion_def>       ion_defs;
+    component_unique<ion_default>   ion_defaults;
+    component_join<ion_parameter>   ion_par_defs;
+    cv_def                          cv_policy_def;
+  };
+
+  // `State` is the `gui_state` or a `decor_inputs` copied from it.
+  template<typename State>
+  arb::decor make_decor(State& state) {
     arb::decor decor{};
     for (const auto& id: state.locsets) {
-      auto ls = state.locset_defs[id];
+      const auto& ls = state.locset_defs[id];
       if (!ls.data) continue;
       auto locset = ls.data.value();
       for (const auto child: state.stimuli.get_children(id)) {
@@ -890,9 +1147,9 @@ namespace {
     }
 
     for (const auto& id: state.regions) {
-      auto rg = state.region_defs[id];
+      const auto& rg = state.region_defs[id];
       if (!rg.data) continue;
-      auto param  = state.parameter_defs[id];
+      const auto& param = state.parameter_defs[id];
       if (param.RL) decor.paint(rg.data.value(), arb::axial_resistivity{param.RL.value() * U::Ohm * U::cm});
       if (param.Cm) decor.paint(rg.data.value(), arb::membrane_capacitance{param.Cm.value() * U::F / U::m2});
       if (param.TK) decor.paint(rg.data.value(), arb::temperature{param.TK.value() * U::Kelvin});
@@ -932,29 +1189,65 @@ namespace {
         }
       }
     }
-    return {state.builder.morph, decor, state.builder.labels};
+    if (state.cv_policy_def.data) decor.set_default(state.cv_policy_def.data.value());
+    return decor;
+  }
+
+  inline arb::cable_cell make_cable_cell(gui_state& state) {
+    return {state.builder.morph, make_decor(state), state.builder.labels};
   }
 
   inline void gui_plot(gui_state& state, std::optional<id_type> to_plot) {
     if (ImGui::BeginChild("TracePlot", {-180.0f, 0.0f})) {
-      if (to_plot) {
+      // All locations of the probe, in sampling order
+      std::vector<const trace*> shown;
+      for (const auto& t: state.sim.traces) {
+        if (to_plot && t.probe == to_plot.value()) shown.push_back(&t);
+      }
+      if (state.sim.exported_only) {
+        ImGui::TextWrapped("Traces were exported to '%s' and not kept in memory.", state.sim.exported_only->c_str());
+      } else if (!shown.empty()) {
         auto probe = to_plot.value();
-        auto trace = state.sim.traces.at(probe.value);
-        const auto& [lo, hi] = std::accumulate(trace.values.begin(),
-                                               trace.values.end(),
-                                               std::make_pair(std::numeric_limits<float>::max(), std::numeric_limits<float>::min()),
-                                               [] (const auto& p, auto x) -> std::pair<float, float> { return { std::min(x, p.first), std::max(x, p.second)};});
-        auto probe_def = state.probes[probe];
-        auto var = fmt::format("{} {}", probe_def.kind, probe_def.variable);
-
-        if (ImPlot::BeginPlot(fmt::format("Probe {} @ branch {} ({})", probe.value, trace.branch, trace.location).c_str(),
-                              ImVec2(-1, -20))) {
-          ImPlot::SetupAxes("Time (t/ms)", var.c_str());
-          ImPlot::SetupAxesLimits(0, state.sim.until, lo, hi);
+        const auto& probe_def = state.probes[probe];
+        auto var = frame_format("{} {}", probe_def.kind, probe_def.variable);
+        auto lo = std::numeric_limits<float>::max(), hi = std::numeric_limits<float>::lowest();
+        size_t samples = 0, bytes = 0;
+        for (const auto* t: shown) {
+          lo = std::min(lo, t->data.range().first);
+          hi = std::max(hi, t->data.range().second);
+          samples += t->data.size();
+          bytes   += t->data.bytes();
+        }
+        auto title = shown.size() == 1 ? frame_format("Probe {} @ branch {} ({})", probe.value, shown[0]->branch, shown[0]->location)
+                                       : frame_format("Probe {} @ {} locations", probe.value, shown.size());
+        // Tell locations apart only where there are several
+        auto name = [&](const trace& t) -> std::string {
+          return shown.size() == 1 ? var : fmt::format("{} @ {}:{:.3f}", var, t.branch, t.location);
+        };
+        if (ImPlot::BeginPlot(title, ImVec2(-1, -20))) {
+          ImPlot::SetupAxes("Time (t/ms)", var);
+          if (samples) ImPlot::SetupAxesLimits(0, state.sim.until, lo, hi);
           ImPlot::SetupFinish();
-          ImPlot::PlotLine(var.c_str(), trace.times.data(), trace.values.data(), trace.values.size());
+          // Only unpack what is on screen, and reduce all runs to the same bins per pixel
+          auto limits  = ImPlot::GetPlotLimits();
+          auto buckets = std::max<size_t>(ImPlot::GetPlotSize().x, 1);
+          static std::vector<float> ts, vs;
+          for (auto& run: state.history.runs) {
+            if (!run.overlay) continue;
+            for (const auto* t: shown) {
+              auto past = state.history.find(run, probe, t->index);
+              if (!past) continue;
+              past->decimate(limits.X.Min, limits.X.Max, buckets, ts, vs);
+              ImPlot::PlotLine(frame_format("Run {}: {}", run.number, name(*t)), ts.data(), vs.data(), ts.size());
+            }
+          }
+          for (const auto* t: shown) {
+            t->data.decimate(limits.X.Min, limits.X.Max, buckets, ts, vs);
+            ImPlot::PlotLine(frame_format("{}", name(*t)), ts.data(), vs.data(), ts.size());
+          }
           ImPlot::EndPlot();
         }
+        ImGui::Text("%zu samples, %.1f kB", samples, bytes/1024.0);
       } else {
         if (ImPlot::BeginPlot("Please select a probe below")) {
           ImPlot::EndPlot();
@@ -964,15 +1257,15 @@ namespace {
     ImGui::EndChild();
   }
 
-  inline void gui_trace_select(gui_state& state, std::optional<id_type> to_plot) {
+  inline void gui_trace_select(gui_state& state, std::optional<id_type>& to_plot) {
     if (ImGui::BeginChild("TraceSelect", {150.0f, 0.0f})) {
       for (const auto& locset: state.locsets) {
         with_id id{locset};
-        auto locset_def = state.locset_defs[locset];
-        if (gui_tree(fmt::format("{} {}", icon_locset, locset_def.name))) {
+        const auto& locset_def = state.locset_defs[locset];
+        if (gui_tree(frame_format("{} {}", icon_locset, locset_def.name))) {
           for (const auto& probe: state.probes.get_children(locset)) {
             const auto& data = state.probes[probe];
-            if(ImGui::RadioButton(fmt::format("{} {}: {} {}", icon_probe, probe.value, data.kind, data.variable).c_str(),
+            if(ImGui::RadioButton(frame_format("{} {}: {} {}", icon_probe, probe.value, data.kind, data.variable),
                                   to_plot && (to_plot.value() == probe))) {
               to_plot = probe;
             }
@@ -980,6 +1273,7 @@ namespace {
           ImGui::TreePop();
         }
       }
+      gui_run_history(state.history, state.run_changes);
     }
     ImGui::EndChild();
   }
@@ -989,23 +1283,36 @@ namespace {
     if (ImGui::Begin("Traces")) {
       gui_plot(state, to_plot);
       ImGui::SameLine();
+      gui_trace_select(state, to_plot);
     }
     ImGui::End();
   }
+
+  void gui_spikes(gui_state& state) {
+    if (ImGui::Begin("Spikes")) ::gui_spikes(state.sim);
+    ImGui::End();
+  }
 } // namespace
 
 void gui_state::gui() {
+  frame_strings.reset();
   update();
   gui_main(*this);
   gui_traces(*this);
+  gui_spikes(*this);
   gui_cell(*this);
   gui_cell_info(*this);
   gui_simulation(*this);
+  update_playback();
   gui_parameters(*this);
   gui_locations(*this);
   handle_keys();
 }
 
+bool gui_state::animating() const { return demo_mode || loading.has_value() || loading_cat.has_value() || tuner.running.has_value() || fit.cma.has_value() || sens.running.has_value() || ens.running.has_value() || sim.playing; }
+
+std::optional<timer::time_point> gui_state::next_deadline() const { return label_deadline; }
+
 void gui_state::serialize(const std::filesystem::path& fn) {
   log_info("Writing acc to {}", fn.string());
   std::ofstream fd(fn);
@@ -1187,6 +1494,7 @@ void gui_state::deserialize(const std::filesystem::path& fn) {
         if (ion == state->ions.end()) log_error("Unknown ion {}.", k);
         state->ion_defaults[*ion].method = v.name();
       }
+      ++state->cv_parameter_version;
     }
   };
 
@@ -1201,107 +1509,301 @@ void gui_state::reset() {
   region_defs.clear();
   ions.clear();
   ion_defs.clear();
+  ion_names.clear();
   probes.clear();
   detectors.clear();
+  stimuli.clear();
   ion_defaults.clear();
   iexpr_defs.clear();
   iexprs.clear();
   mechanisms.clear();
-  segment_to_regions.clear();
+  parameter_defs.clear();
+  ion_par_defs.clear();
+  region_members.clear();
+  edited_regions.clear();
+  edited_locsets.clear();
+  edited_iexprs.clear();
+  label_deadline.reset();
+  ++label_generation;
+  discretising.reset();
+  discretisations.clear();
+  tuner.candidates.clear();
+  sim.recording.reset();
+  sim.spikes.clear();
+  sim.playing = false;
+  history.clear();
+  run_number = 0;
+  run_params.clear();
+  run_changes.clear();
   renderer.clear();
   const static std::vector<std::pair<std::string, int>> species{{"na", 1}, {"k", 1}, {"ca", 2}};
   for (const auto& [k, v]: species) add_ion(k, v);
 }
 
 void gui_state::reload(const io::loaded_morphology& result) {
+  task_progress progress{load_stages};
+  finish_load(prepare_morphology(result, renderer.n_faces, renderer.ax.scale, progress));
+}
+
+void gui_state::start_load(const std::filesystem::path& fn, const io::load_fn& load) {
+  if (loading) loading->cancel();
+  loading.emplace(load_stages,
+                  [fn, load, n_faces=renderer.n_faces, scale=renderer.ax.scale](task_progress& progress) {
+                    progress.enter(0);
+                    auto loaded = load(fn);
+                    return prepare_morphology(loaded, n_faces, scale, progress);
+                  });
+}
+
+void gui_state::start_load_catalogue(const std::string& name, const std::filesystem::path& fn) {
+  loading_cat.emplace(std::vector<std::string>{"Loading", "Validating"},
+                      [name, fn, ion_names=ion_names](task_progress& progress) {
+                        return load_catalogue(name, fn, ion_names, progress);
+                      });
+}
+
+void gui_state::poll_catalogues() {
+  if (loading_cat && loading_cat->ready()) {
+    auto done = std::move(loading_cat.value());
+    loading_cat.reset();
+    try {
+      auto result = done.get();
+      for (const auto& warning: result.warnings) log_warn("Catalogue '{}': {}", result.name, warning);
+      add_catalogue(result.name, result.catalogue);
+      auto it = std::find_if(catalogue_sources.begin(), catalogue_sources.end(),
+                             [&](const auto& src) { return src.name == result.name; });
+      if (it == catalogue_sources.end()) {
+        catalogue_sources.push_back({result.name, result.path, result.mtime, watch_cat});
+      } else {
+        it->mtime = result.mtime;
+      }
+      log_info("Loaded catalogue '{}' from {}", result.name, result.path.string());
+    } catch (const task_cancelled&) {
+    } catch (const std::exception& e) {
+      log_warn("Failed to load catalogue: {}", e.what());
+      catalogue_error = e.what();
+    }
+  }
+  if (loading_cat) return;
+  auto now = timer::now();
+  if (next_cat_check && now < *next_cat_check) return;
+  next_cat_check = now + std::chrono::seconds(1);
+  for (auto& src: catalogue_sources) {
+    if (!src.watch) continue;
+    std::error_code ec;
+    auto mtime = std::filesystem::last_write_time(src.path, ec);
+    if (ec || mtime == src.mtime) continue;
+    // Remember right away, so a broken build is not retried until the next one.
+    src.mtime = mtime;
+    log_info("Reloading catalogue '{}'", src.name);
+    start_load_catalogue(src.name, src.path);
+    return;
+  }
+}
+
+void gui_state::finish_load(prepared_morphology&& result) {
   reset();
-  builder = cell_builder{result.morph};
-  renderer.load_geometry(result.morph, true);
-  for (const auto& [k, v]: result.regions) add_region(k, v);
-  for (const auto& [k, v]: result.locsets) add_locset(k, v);
-  for (const auto& [k, v]: result.iexprs) add_iexpr(k, v);
+  builder = std::move(result.builder);
+  renderer.load_mesh(std::move(result.cell_mesh), true);
+  for (auto ix = 0ul; ix < result.regions.size(); ++ix) {
+    const auto& def = result.regions[ix];
+    auto id = insert_region(def);
+    if (def.state == def_state::good) set_region_segments(id, result.region_segments[ix]);
+  }
+  for (auto ix = 0ul; ix < result.locsets.size(); ++ix) {
+    const auto& def = result.locsets[ix];
+    auto id = insert_locset(def);
+    if (def.state == def_state::good) renderer.make_marker(result.locset_points[ix], renderer.locsets[id]);
+  }
+  for (const auto& def: result.iexprs) {
+    auto id = insert_iexpr(def);
+    if (def.state == def_state::good) renderer.make_iexpr(def.info, renderer.iexprs[id]);
+  }
   cv_policy_def.definition = "";
   update_cv_policy();
 }
 
+id_type gui_state::insert_region(const rg_def& def) {
+  auto id = regions.add();
+  region_defs.add(id, def);
+  if (def.name.empty()) region_defs[id].name = fmt::format("Region {}", id.value);
+  parameter_defs.add(id);
+  renderer.regions.add(id);
+  renderer.regions[id].color = next_color();
+  for (const auto& ion: ions) ion_par_defs.add(id, ion);
+  return id;
+}
+
+id_type gui_state::insert_locset(const ls_def& def) {
+  auto id = locsets.add();
+  locset_defs.add(id, def);
+  if (def.name.empty()) locset_defs[id].name = fmt::format("Locset {}", id.value);
+  renderer.locsets.add(id);
+  renderer.locsets[id].color = next_color();
+  return id;
+}
+
+id_type gui_state::insert_iexpr(const ie_def& def) {
+  auto id = iexprs.add();
+  iexpr_defs.add(id, def);
+  if (def.name.empty()) iexpr_defs[id].name = fmt::format("Iexpr {}", id.value);
+  renderer.iexprs.add(id);
+  renderer.iexprs[id].color = next_color();
+  return id;
+}
+
+void gui_state::concretise(const std::vector<id_type>& new_regions,
+                           const std::vector<id_type>& new_locsets,
+                           const std::vector<id_type>& new_iexprs) {
+  // Pending edits are folded in; evaluations in flight are outdated now.
+  auto rgs = std::exchange(edited_regions, {});
+  auto lss = std::exchange(edited_locsets, {});
+  auto ies = std::exchange(edited_iexprs,  {});
+  rgs.insert(rgs.end(), new_regions.begin(), new_regions.end());
+  lss.insert(lss.end(), new_locsets.begin(), new_locsets.end());
+  ies.insert(ies.end(), new_iexprs.begin(),  new_iexprs.end());
+  label_deadline.reset();
+  ++label_generation;
+  render_labels(evaluate_labels(builder, region_defs, locset_defs, iexpr_defs, rgs, lss, ies));
+}
+
+void gui_state::render_labels(const label_update& update) {
+  for (auto ix = 0ul; ix < update.regions.size(); ++ix) {
+    const auto& id = update.regions[ix];
+    if (region_defs[id].state == def_state::good) {
+      set_region_segments(id, update.region_segments[ix]);
+    } else {
+      region_members.erase(id);
+      renderer.regions[id].active = false;
+    }
+  }
+  for (auto ix = 0ul; ix < update.locsets.size(); ++ix) {
+    const auto& id = update.locsets[ix];
+    if (locset_defs[id].state == def_state::good) renderer.make_marker(update.locset_points[ix], renderer.locsets[id]);
+    else renderer.locsets[id].active = false;
+  }
+  for (const auto& id: update.iexprs) {
+    const auto& def = iexpr_defs[id];
+    if (def.state == def_state::good) renderer.make_iexpr(def.info, renderer.iexprs[id]);
+    else renderer.iexprs[id].active = false;
+  }
+  // Policies may refer to labels
+  make_cv_boundaries();
+}
+
+void gui_state::touch_labels() {
+  ++label_generation;
+  label_deadline = timer::now() + label_debounce;
+}
+
+void gui_state::poll_labels() {
+  if (evaluating && evaluating->ready()) {
+    auto done = std::move(evaluating.value());
+    evaluating.reset();
+    auto result = done.get();
+    if (result.generation == label_generation) {
+      builder = std::move(result.builder);
+      apply_label_results(region_defs, result.region_defs);
+      apply_label_results(locset_defs, result.locset_defs);
+      apply_label_results(iexpr_defs,  result.iexpr_defs);
+      for (const auto& id: result.update.iexprs) iexpr_defs[id].info = std::move(result.iexpr_defs[id].info);
+      render_labels(result.update);
+    } else {
+      // Superseded; evaluate these again with the next batch.
+      const auto& upd = result.update;
+      edited_regions.insert(edited_regions.end(), upd.regions.begin(), upd.regions.end());
+      edited_locsets.insert(edited_locsets.end(), upd.locsets.begin(), upd.locsets.end());
+      edited_iexprs.insert(edited_iexprs.end(), upd.iexprs.begin(), upd.iexprs.end());
+      if (!label_deadline) label_deadline = timer::now();
+    }
+  }
+  if (evaluating || !label_deadline || timer::now() < *label_deadline) return;
+  label_deadline.reset();
+  evaluating.emplace(std::vector<std::string>{"Labels"},
+                     [generation=label_generation,
+                      builder=builder.label_worker(),
+                      region_defs=label_inputs(region_defs),
+                      locset_defs=label_inputs(locset_defs),
+                      iexpr_defs=label_inputs(iexpr_defs),
+                      regions=std::exchange(edited_regions, {}),
+                      locsets=std::exchange(edited_locsets, {}),
+                      iexprs=std::exchange(edited_iexprs, {})](task_progress&) mutable {
+                       label_evaluation result{.generation=generation,
+                                               .builder=std::move(builder),
+                                               .region_defs=std::move(region_defs),
+                                               .locset_defs=std::move(locset_defs),
+                                               .iexpr_defs=std::move(iexpr_defs)};
+                       result.update = evaluate_labels(result.builder, result.region_defs, result.locset_defs, result.iexpr_defs,
+                                                       regions, locsets, iexprs);
+                       return result;
+                     });
+}
+
+void gui_state::set_region_segments(const id_type& id, const std::vector<arb::msegment>& segments) {
+  segment_set members;
+  for (const auto& segment: segments) {
+    const auto cached = renderer.segments[renderer.id_to_index[segment.id]];
+    if ((cached.dist != segment.prox) && (cached.prox != segment.dist)) members.set(segment.id);
+  }
+  region_members.set(id, std::move(members));
+  renderer.make_region(segments, renderer.regions[id]);
+}
+
 void gui_state::update() {
+  // Events run in the order they were raised. Repeated updates of one target
+  // are merged and events for targets deleted earlier are dropped. Label
+  // additions and deletions are concretised in one batch and the CV
+  // boundaries are rebuilt at most once after all events ran.
   struct event_visitor {
     gui_state* state;
+    // Labels added this frame
+    std::vector<id_type> new_regions, new_locsets, new_iexprs;
+    // Labels updated this frame
+    std::unordered_set<id_type> upd_regions, upd_locsets, upd_iexprs;
+    bool labels_deleted = false;
+    bool cv_changed     = false;
+    bool ions_changed   = false;
 
     event_visitor(gui_state* state_): state{state_} {}
 
-    void operator()(const evt_upd_cv&) {
-      auto& def = state->cv_policy_def;
-      auto& rnd = state->renderer.cv_boundaries;
-      def.update();
-      if (def.state != def_state::error) {
-        try {
-          auto points = state->builder.make_boundary(def.data.value());
-          state->renderer.make_marker(points, rnd);
-        } catch (const arb::arbor_exception& e) {
-          def.set_error(e.what()); rnd.active = false;
-        }
-      }
-      if (def.definition.empty()) rnd.active = false;
-    }
+    void operator()(const evt_upd_cv&) { cv_changed = true; }
     void operator()(const evt_add_locdef<ls_def>& c) {
-      auto ls = state->locsets.add();
-      state->locset_defs.add(ls, {c.name.empty() ? fmt::format("Locset {}", ls.value) : c.name, c.definition});
-      state->renderer.locsets.add(ls);
-      state->renderer.locsets[ls].color = next_color();
-      state->update_locset(ls);
+      new_locsets.push_back(state->insert_locset({c.name, c.definition}));
     }
     void operator()(const evt_upd_locdef<ls_def>& c) {
+      if (!state->locset_defs.contains(c.id) || !upd_locsets.insert(c.id).second) return;
       auto& def = state->locset_defs[c.id];
-      auto& rnd = state->renderer.locsets[c.id];
       def.update();
-      if (def.state == def_state::good) {
-        log_info("Making markers for locset {} '{}'", def.name, def.definition);
-        try {
-          auto points = state->builder.make_points(def.data.value());
-          state->renderer.make_marker(points, rnd);
-        } catch (const arb::arbor_exception& e) {
-          def.set_error(e.what()); rnd.active = false;
-        }
-      }
-      state->builder.make_label_dict(state->locset_defs.items, state->region_defs.items, state->iexpr_defs.items);
+      if (def.state == def_state::error) state->renderer.locsets[c.id].active = false;
+      state->edited_locsets.push_back(c.id);
+      state->touch_labels();
     }
     void operator()(const evt_del_locdef<ls_def>& c) {
       auto id = c.id;
+      if (!state->locset_defs.contains(id)) return;
       log_debug("Erasing locset {}", id.value);
       state->renderer.locsets.del(id);
       state->locset_defs.del(id);
       state->probes.del_children(id);
       state->detectors.del_children(id);
+      state->stimuli.del_children(id);
       state->locsets.del(id);
-      state->builder.make_label_dict(state->locset_defs.items, state->region_defs.items, state->iexpr_defs.items);
+      labels_deleted = true;
     }
     void operator()(const evt_add_locdef<ie_def>& c) {
-      auto id = state->iexprs.add();
-      state->iexpr_defs.add(id, {c.name.empty() ? fmt::format("Iexpr {}", id.value) : c.name, c.definition});
-      // TODO rendering?
-      state->renderer.iexprs.add(id);
-      state->renderer.iexprs[id].color = next_color();
-      state->update_iexpr(id);
+      new_iexprs.push_back(state->insert_iexpr({c.name, c.definition}));
     }
     void operator()(const evt_upd_locdef<ie_def>& c) {
+      if (!state->iexpr_defs.contains(c.id) || !upd_iexprs.insert(c.id).second) return;
       auto& def = state->iexpr_defs[c.id];
-      auto& rnd = state->renderer.iexprs[c.id];
       def.update();
-      if (def.state == def_state::good) {
-        try {
-          log_info("Making iexpr {} '{}'", def.name, def.definition);
-          def.info = state->builder.make_iexpr(def.data.value());
-          state->renderer.make_iexpr(def.info, rnd);
-        } catch (const arb::arbor_exception& e) {
-          def.set_error(e.what()); rnd.active = false;
-        }
-      }
-      def.update();
-      state->builder.make_label_dict(state->locset_defs.items, state->region_defs.items, state->iexpr_defs.items);
+      if (def.state == def_state::error) state->renderer.iexprs[c.id].active = false;
+      state->edited_iexprs.push_back(c.id);
+      state->touch_labels();
     }
     void operator()(const evt_del_locdef<ie_def>& c) {
       auto id = c.id;
+      if (!state->iexpr_defs.contains(id)) return;
       log_debug("Erasing iexpr {}", id.value);
       auto nm = state->iexpr_defs[id].name;
       for(auto& m: state->mechanisms.items) {
@@ -1312,87 +1814,151 @@ void gui_state::update() {
       state->iexpr_defs.del(id);
       state->iexprs.del(id);
       state->renderer.iexprs.del(id);
-      state->builder.make_label_dict(state->locset_defs.items, state->region_defs.items, state->iexpr_defs.items);
+      labels_deleted = true;
     }
     void operator()(const evt_add_locdef<rg_def>& c) {
-      auto id = state->regions.add();
-      state->region_defs.add(id, {c.name.empty() ? fmt::format("Region {}", id.value) : c.name, c.definition});
-      state->parameter_defs.add(id);
-      state->renderer.regions.add(id);
-      state->renderer.regions[id].color = next_color();
-      for (const auto& ion: state->ions) state->ion_par_defs.add(id, ion);
-      state->update_region(id);
+      new_regions.push_back(state->insert_region({c.name, c.definition}));
     }
     void operator()(const evt_upd_locdef<rg_def>& c) {
+      if (!state->region_defs.contains(c.id) || !upd_regions.insert(c.id).second) return;
       auto& def = state->region_defs[c.id];
-      auto& rnd = state->renderer.regions[c.id];
-      for(auto& [segment, regions]: state->segment_to_regions) regions.erase(c.id);
       def.update();
-      if (def.state == def_state::good) {
-        log_info("Making frustrums for region {} '{}'", def.name, def.definition);
-        try {
-          auto segments = state->builder.make_segments(def.data.value());
-          for (const auto& segment: segments) {
-            const auto cached = state->renderer.segments[state->renderer.id_to_index[segment.id]];
-            if ((cached.dist != segment.prox) && (cached.prox != segment.dist)) {
-              state->segment_to_regions[segment.id].insert(c.id);
-            }
-          }
-          state->renderer.make_region(segments, rnd);
-        } catch (const arb::arbor_exception& e) {
-          def.set_error(e.what()); rnd.active = false;
-        }
-      }
-      state->builder.make_label_dict(state->locset_defs.items, state->region_defs.items, state->iexpr_defs.items);
+      if (def.state == def_state::error) state->renderer.regions[c.id].active = false;
+      state->edited_regions.push_back(c.id);
+      state->touch_labels();
     }
     void operator()(const evt_del_locdef<rg_def>& c) {
       auto id = c.id;
+      if (!state->region_defs.contains(id)) return;
       state->renderer.regions.del(id);
       state->region_defs.del(id);
       state->parameter_defs.del(id);
       state->ion_par_defs.del_by_1st(id);
       state->mechanisms.del_children(id);
-      // TODO This is quite expensive ... see if we can keep it this way
-      for(auto& [segment, regions]: state->segment_to_regions) regions.erase(id);
+      state->region_members.erase(id);
       state->regions.del(id);
-      state->builder.make_label_dict(state->locset_defs.items, state->region_defs.items, state->iexpr_defs.items);
+      labels_deleted = true;
     }
     void operator()(const evt_add_ion& c) {
       auto id = state->ions.add();
       state->ion_defs.add(id, {c.name.empty() ? fmt::format("Ion {}", id.value) : c.name, c.charge});
       state->ion_defaults.add(id);
       for (const auto& region: state->regions) state->ion_par_defs.add(region, id);
+      ions_changed = true;
     }
+    void operator()(const evt_upd_ion&) { ions_changed = true; }
     void operator()(const evt_del_ion& c) {
       auto id = c.id;
+      if (!state->ion_defs.contains(id)) return;
       state->ion_defs.del(id);
       state->ion_defaults.del(id);
       state->ion_par_defs.del_by_2nd(id);
       state->ions.del(id);
+      ions_changed = true;
     }
-    void operator()(const evt_add_mechanism& c) {  state->mechanisms.add(c.region); }
-    void operator()(const evt_del_mechanism& c) {  state->mechanisms.del(c.id); }
+    void operator()(const evt_add_mechanism& c) {  if (state->region_defs.contains(c.region)) state->mechanisms.add(c.region); }
+    void operator()(const evt_del_mechanism& c) {  if (state->mechanisms.contains(c.id)) state->mechanisms.del(c.id); }
     void operator()(const evt_add_detector& c)  {
+      if (!state->locset_defs.contains(c.locset)) return;
       auto id = state->detectors.add(c.locset);
       auto& data = state->detectors[id];
       if (data.tag.empty()) data.tag = fmt::format("Detector {}", id.value);
     }
-    void operator()(const evt_del_detector& c)  {  state->detectors.del(c.id); }
-    void operator()(const evt_add_probe& c)     {  state->probes.add(c.locset); }
-    void operator()(const evt_del_probe& c)     {  state->probes.del(c.id); }
+    void operator()(const evt_del_detector& c)  {  if (state->detectors.contains(c.id)) state->detectors.del(c.id); }
+    void operator()(const evt_add_probe& c)     {  if (state->locset_defs.contains(c.locset)) state->probes.add(c.locset); }
+    void operator()(const evt_del_probe& c)     {  if (state->probes.contains(c.id)) state->probes.del(c.id); }
     void operator()(const evt_add_stimulus& c)  {
+      if (!state->locset_defs.contains(c.locset)) return;
       auto id = state->stimuli.add(c.locset);
       auto& data = state->stimuli[id];
       if (data.tag.empty()) data.tag = fmt::format("I Clamp {}", id.value);
     }
-    void operator()(const evt_del_stimulus& c)  {  state->stimuli.del(c.id); }
+    void operator()(const evt_del_stimulus& c)  {  if (state->stimuli.contains(c.id)) state->stimuli.del(c.id); }
   };
 
+  event_visitor visitor{this};
+  // Handlers may raise further events; those run in the same frame.
   while (!events.empty()) {
-    auto evt = events.back();
-    events.pop_back();
-    std::visit(event_visitor{this}, evt);
+    auto batch = std::exchange(events, {});
+    for (const auto& evt: batch) std::visit(visitor, evt);
+  }
+  if (visitor.labels_deleted || !visitor.new_regions.empty() || !visitor.new_locsets.empty() || !visitor.new_iexprs.empty()) {
+    concretise(visitor.new_regions, visitor.new_locsets, visitor.new_iexprs);
+  }
+  if (visitor.cv_changed) make_cv_boundaries();
+  // RL or Cm changed since; redo the statistics
+  if (cv_parameter_version != shown_cv_version && cv_policy_def.data) show_cv_boundaries();
+  if (visitor.ions_changed) {
+    ion_names.clear();
+    for (const auto& ion: ions) ion_names.push_back(ion_defs[ion].name);
   }
+  poll_labels();
+  poll_cv_boundaries();
+  poll_catalogues();
+  poll_cv_tuner(tuner);
+  poll_fitting();
+  poll_sensitivity(sens);
+  poll_ensemble(ens);
+  history.poll();
+}
+
+void gui_state::make_cv_boundaries() {
+  cv_policy_def.update();
+  show_cv_boundaries();
+}
+
+gui_state::cv_key gui_state::current_cv_key() const {
+  auto Ra = parameter_defaults.RL.value_or(presets.axial_resistivity.value());
+  auto Cm = parameter_defaults.Cm.value_or(presets.membrane_capacitance.value());
+  std::vector<std::tuple<id_type, std::optional<double>, std::optional<double>>> painted;
+  for (const auto& id: regions) {
+    const auto& param = parameter_defs[id];
+    if (region_defs[id].data && (param.RL || param.Cm)) painted.emplace_back(id, param.RL, param.Cm);
+  }
+  return {cv_policy_def.definition, builder.label_version, Ra, Cm, std::move(painted)};
+}
+
+void gui_state::show_cv_boundaries() {
+  auto& def = cv_policy_def;
+  auto& rnd = renderer.cv_boundaries;
+  shown_cv_key     = current_cv_key();
+  shown_cv_version = cv_parameter_version;
+  if (def.state == def_state::error) return;
+  const auto& key = shown_cv_key;
+  if (auto it = discretisations.find(key); it != discretisations.end()) {
+    const auto& cvs = it->second;
+    if (cvs.error.empty()) {
+      renderer.make_marker(cvs.boundaries, rnd);
+    } else {
+      def.set_error(cvs.error); rnd.active = false;
+    }
+    if (def.definition.empty()) rnd.active = false;
+    return;
+  }
+  // Else, wait for the running one; `poll_cv_boundaries` comes back here.
+  if (discretising) return;
+  std::vector<cv_parameters> painted;
+  for (const auto& [id, RL, Cm]: std::get<4>(key)) painted.push_back({region_defs[id].data.value(), RL, Cm});
+  discretising_key = key;
+  discretising.emplace(std::vector<std::string>{"Discretising"},
+                       [builder=builder, policy=def.data.value(), Ra=std::get<2>(key), Cm=std::get<3>(key), painted=std::move(painted)](task_progress&) mutable {
+                         try {
+                           return builder.make_discretisation(policy, Ra, Cm, painted);
+                         } catch (const arb::arbor_exception& e) {
+                           return cv_discretisation{.error=e.what()};
+                         }
+                       });
+}
+
+void gui_state::poll_cv_boundaries() {
+  if (!discretising || !discretising->ready()) return;
+  auto done = std::move(discretising.value());
+  discretising.reset();
+  // Older label versions cannot come back; beyond that, just bound the cache.
+  std::erase_if(discretisations, [&](const auto& kv) { return std::get<1>(kv.first) != builder.label_version; });
+  if (discretisations.size() > 32) discretisations.clear();
+  discretisations[discretising_key] = done.get();
+  show_cv_boundaries();
 }
 
 bool gui_state::store_snapshot() {
@@ -1411,19 +1977,16 @@ void gui_state::handle_keys() {
   if (ImGui::IsKeyPressed(ImGuiKey_O) && (ImGui::IsKeyDown(ImGuiKey_ModCtrl) || ImGui::IsKeyDown(ImGuiKey_ModSuper))) open_morph_read = true;
 }
 
-void gui_state::run_simulation() {
-  auto cell  = make_cable_cell(*this);
-
-  auto prop  = arb::cable_cell_global_properties{};
+model gui_state::make_model(bool cell_wide) {
+  auto result = model{.morph=builder.morph, .decor=make_decor(*this), .labels=builder.labels};
+  auto& prop = result.properties;
   prop.default_parameters = presets;
   if (parameter_defaults.TK) prop.default_parameters.temperature_K           = parameter_defaults.TK;
   if (parameter_defaults.RL) prop.default_parameters.axial_resistivity       = parameter_defaults.RL;
   if (parameter_defaults.Cm) prop.default_parameters.membrane_capacitance    = parameter_defaults.Cm;
   if (parameter_defaults.Vm) prop.default_parameters.init_membrane_potential = parameter_defaults.Vm;
 
-  auto cat = arb::mechanism_catalogue{};
-  for (const auto& [k, v]: catalogues) cat.extend(v, k + "::");
-  prop.catalogue = cat;
+  prop.catalogue = catalogue_meta().merged;
 
   for (const auto& ion: ions) {
     const auto& data   = ion_defs[ion];
@@ -1445,7 +2008,6 @@ void gui_state::run_simulation() {
                    def.Er.value() * U::mV);
     }
   }
-  auto rec = make_recipe(prop, cell);
   for (const auto& ls: locsets) {
     for (const auto pb: probes.get_children(ls)) {
       const auto& data = probes[pb];
@@ -1454,46 +2016,466 @@ void gui_state::run_simulation() {
       auto loc = where.data.value();
       // TODO this is quite crude...
       auto tag = std::to_string(pb.value);
+      const auto& var = data.variable;
       if (data.kind == "Voltage") {
-        rec.probes.emplace_back(arb::cable_probe_membrane_voltage{loc}, tag);
+        result.probes.emplace_back(arb::cable_probe_membrane_voltage{loc}, tag);
       } else if (data.kind == "Axial Current") {
-        rec.probes.emplace_back(arb::cable_probe_axial_current{loc}, tag);
+        result.probes.emplace_back(arb::cable_probe_axial_current{loc}, tag);
       } else if (data.kind == "Membrane Current") {
-        rec.probes.emplace_back(arb::cable_probe_total_ion_current_density{loc}, tag);
+        if (var.empty()) result.probes.emplace_back(arb::cable_probe_total_ion_current_density{loc}, tag);
+        else             result.probes.emplace_back(arb::cable_probe_ion_current_density{loc, var}, tag);
+      } else if (var.empty()) {
+        log_warn("Probe {} ({}) has no variable, skipping", pb.value, data.kind);
+      } else if (data.kind == "Internal Concentration") {
+        result.probes.emplace_back(arb::cable_probe_ion_int_concentration{loc, var}, tag);
+      } else if (data.kind == "External Concentration") {
+        result.probes.emplace_back(arb::cable_probe_ion_ext_concentration{loc, var}, tag);
+      } else if (data.kind == "Mechanism State") {
+        auto [mech, state] = split_state_variable(var);
+        result.probes.emplace_back(arb::cable_probe_density_state{loc, mech, state}, tag);
       }
-      // TODO Finish
     }
   }
+  // Cell-wide, vector valued
+  if (!cell_wide) return result;
+  const auto& kind = sim.record_cell;
+  const auto& var  = sim.record_variable;
+  if (kind == "Voltage") {
+    result.probes.emplace_back(arb::cable_probe_membrane_voltage_cell{}, cell_tag);
+  } else if (kind == "Membrane Current") {
+    result.probes.emplace_back(arb::cable_probe_total_current_cell{}, cell_tag);
+  } else if (kind == "Off") {
+  } else if (var.empty()) {
+    log_warn("Cell-wide {} has no variable, skipping", kind);
+  } else if (kind == "Internal Concentration") {
+    result.probes.emplace_back(arb::cable_probe_ion_int_concentration_cell{var}, cell_tag);
+  } else if (kind == "External Concentration") {
+    result.probes.emplace_back(arb::cable_probe_ion_ext_concentration_cell{var}, cell_tag);
+  } else if (kind == "Mechanism State") {
+    auto [mech, state] = split_state_variable(var);
+    result.probes.emplace_back(arb::cable_probe_density_state_cell{mech, state}, cell_tag);
+  }
+  return result;
+}
+
+void gui_state::update_playback() {
+  auto& rec = sim.recording;
+  if (!rec || rec->times.empty() || !renderer.playback.active) return;
+  if (sim.playing) {
+    sim.play_time += sim.play_speed*ImGui::GetIO().DeltaTime;
+    if (sim.play_time >= rec->times.back()) {
+      sim.play_time = rec->times.back();
+      sim.playing   = false;
+    }
+  }
+  auto it = std::upper_bound(rec->times.begin(), rec->times.end(), sim.play_time);
+  size_t sample = std::max<ptrdiff_t>(it - rec->times.begin() - 1, 0);
+  if (sample == sim.play_sample) return;
+  renderer.set_playback(rec->at(sample), rec->lo, rec->hi);
+  sim.play_sample = sample;
+}
+
+void gui_state::start_cv_tuning() {
+  if (label_deadline || evaluating) concretise({}, {}, {});
+  if (tuner.running) tuner.running->cancel();
+  tuner.running.emplace(std::vector<std::string>{"Simulating"},
+                        [mdl=make_model(false), until=sim.until, dt=sim.dt, extents=tuner.extents()](task_progress& progress) {
+                          return tune_cv_policy(mdl, until, dt, extents, progress);
+                        });
+}
+
+run_parameters gui_state::describe_parameters() {
+  run_parameters result;
+  auto put = [&](const std::string& key, const std::optional<double>& value) { if (value) result[key] = fmt::format("{}", value.value()); };
+  result["sim/until"] = fmt::format("{}", sim.until);
+  result["sim/dt"]    = fmt::format("{}", sim.dt);
+  result["cv-policy"] = cv_policy_def.definition;
+  put("default/TK", parameter_defaults.TK);
+  put("default/Cm", parameter_defaults.Cm);
+  put("default/Vm", parameter_defaults.Vm);
+  put("default/RL", parameter_defaults.RL);
+  for (const auto& ion: ions) {
+    const auto& name = ion_defs[ion].name;
+    const auto& def  = ion_defaults[ion];
+    put(fmt::format("default/{}/Xi", name), def.Xi);
+    put(fmt::format("default/{}/Xo", name), def.Xo);
+    put(fmt::format("default/{}/Er", name), def.Er);
+    result[fmt::format("default/{}/method", name)] = def.method;
+  }
+  for (const auto& id: regions) {
+    const auto& region = region_defs[id].name;
+    const auto& param  = parameter_defs[id];
+    put(fmt::format("{}/TK", region), param.TK);
+    put(fmt::format("{}/Cm", region), param.Cm);
+    put(fmt::format("{}/Vm", region), param.Vm);
+    put(fmt::format("{}/RL", region), param.RL);
+    for (const auto& ion: ions) {
+      const auto& name = ion_defs[ion].name;
+      const auto& data = ion_par_defs[{id, ion}];
+      put(fmt::format("{}/{}/Xi", region, name), data.Xi);
+      put(fmt::format("{}/{}/Xo", region, name), data.Xo);
+      put(fmt::format("{}/{}/Er", region, name), data.Er);
+    }
+    for (const auto child: mechanisms.get_children(id)) {
+      const auto& item = mechanisms[child];
+      auto mech = fmt::format("{}/{}::{}", region, item.cat, item.name);
+      result[mech] = "painted";
+      for (const auto& [k, v]: item.globals)    result[fmt::format("{}/{}", mech, k)] = fmt::format("{}", v);
+      for (const auto& [k, v]: item.parameters) result[fmt::format("{}/{}", mech, k)] = fmt::format("{}", v);
+    }
+  }
+  for (const auto& id: locsets) {
+    const auto& locset = locset_defs[id].name;
+    for (const auto child: stimuli.get_children(id)) {
+      const auto& item = stimuli[child];
+      auto stim = fmt::format("{}/stimulus/{}", locset, item.tag);
+      result[fmt::format("{}/frequency", stim)] = fmt::format("{}", item.frequency);
+      result[fmt::format("{}/phase", stim)]     = fmt::format("{}", item.phase);
+      for (const auto& [t, i]: item.envelope) result[fmt::format("{}/envelope/{}", stim, t)] = fmt::format("{}", i);
+    }
+    for (const auto child: detectors.get_children(id)) {
+      const auto& item = detectors[child];
+      result[fmt::format("{}/detector/{}", locset, item.tag)] = fmt::format("{}", item.threshold);
+    }
+  }
+  return result;
+}
+
+namespace {
+  // Where `v` is kept; region and ion values may be unset and fall back to the defaults.
+  template<typename State>
+  std::variant<std::optional<double>*, double*> locate(State& state, const model_value& v) {
+    switch (v.kind) {
+      case model_value::region:
+        if (state.parameter_defs.contains(v.owner)) {
+          auto& p = state.parameter_defs[v.owner];
+          if (v.name == "TK") return &p.TK;
+          if (v.name == "Cm") return &p.Cm;
+          if (v.name == "Vm") return &p.Vm;
+          if (v.name == "RL") return &p.RL;
+        }
+        break;
+      case model_value::ion:
+        if (state.ion_defaults.contains(v.owner)) {
+          auto& p = state.ion_defaults[v.owner];
+          if (v.name == "Xi") return &p.Xi;
+          if (v.name == "Xo") return &p.Xo;
+          if (v.name == "Er") return &p.Er;
+        }
+        break;
+      case model_value::mechanism:
+        if (state.mechanisms.contains(v.owner)) {
+          auto& m = state.mechanisms[v.owner];
+          if (auto it = m.parameters.find(v.name); it != m.parameters.end()) return &it->second;
+          if (auto it = m.globals.find(v.name); it != m.globals.end()) return &it->second;
+        }
+        break;
+    }
+    log_error("'{}' is no longer part of the model.", v.label);
+    return {};
+  }
+
+  // Result of `f()` with `values` swapped in for the settings of `targets`; what was there is put back.
+  template<typename State, typename F>
+  auto with_values(State& state, const std::vector<model_value>& targets, const std::vector<double>& values, F f) {
+    std::vector<std::variant<std::optional<double>, double>> saved;
+    auto restore = [&] {
+      for (auto ix = saved.size(); ix-- > 0;) {
+        std::visit([&](auto* p) { *p = std::get<std::remove_pointer_t<decltype(p)>>(saved[ix]); }, locate(state, targets[ix]));
+      }
+    };
+    try {
+      for (auto ix = 0ul; ix < targets.size(); ++ix) {
+        std::visit([&](auto* p) { saved.emplace_back(*p); *p = values[ix]; }, locate(state, targets[ix]));
+      }
+      auto result = f();
+      restore();
+      return result;
+    } catch (...) {
+      restore();
+      throw;
+    }
+  }
+}
+
+std::vector<std::pair<model_value, double>> gui_state::model_values() {
+  std::vector<std::pair<model_value, double>> result;
+  auto add = [&](model_value::kind_type kind, const id_type& owner, const std::string& name, const std::string& label) {
+    model_value v{.kind=kind, .owner=owner, .name=name, .label=label};
+    result.emplace_back(v, get_value(v));
+  };
+  for (const auto& region: regions) {
+    const auto& rg = region_defs[region].name;
+    for (const auto& name: {"TK", "Cm", "Vm", "RL"}) add(model_value::region, region, name, fmt::format("{}/{}", rg, name));
+    for (const auto child: mechanisms.get_children(region)) {
+      const auto& item = mechanisms[child];
+      for (const auto& [k, v]: item.parameters) add(model_value::mechanism, child, k, fmt::format("{}/{}/{}", rg, item.name, k));
+      for (const auto& [k, v]: item.globals)    add(model_value::mechanism, child, k, fmt::format("{}/{}/{}", rg, item.name, k));
+    }
+  }
+  for (const auto& ion: ions) {
+    const auto& name = ion_defs[ion].name;
+    for (const auto& value: {"Xi", "Xo", "Er"}) add(model_value::ion, ion, value, fmt::format("{}/{}", name, value));
+  }
+  return result;
+}
+
+double gui_state::get_value(const model_value& v) {
+  auto where = locate(*this, v);
+  if (auto p = std::get_if<double*>(&where)) return **p;
+  if (const auto& value = *std::get<std::optional<double>*>(where)) return value.value();
+  auto pick = [](const std::optional<double>& a, const std::optional<double>& b) { return a.value_or(b.value_or(0.0)); };
+  if (v.kind == model_value::ion) {
+    const auto& def = ion_defaults[v.owner];
+    auto it = presets.ion_data.find(ion_defs[v.owner].name);
+    if (it == presets.ion_data.end()) return 0.0;
+    if (v.name == "Xi") return pick(def.Xi, it->second.init_int_concentration);
+    if (v.name == "Xo") return pick(def.Xo, it->second.init_ext_concentration);
+    return pick(def.Er, it->second.init_reversal_potential);
+  }
+  if (v.name == "TK") return pick(parameter_defaults.TK, presets.temperature_K);
+  if (v.name == "Cm") return pick(parameter_defaults.Cm, presets.membrane_capacitance);
+  if (v.name == "Vm") return pick(parameter_defaults.Vm, presets.init_membrane_potential);
+  return pick(parameter_defaults.RL, presets.axial_resistivity);
+}
+
+void gui_state::set_value(const model_value& v, double x) {
+  std::visit([&](auto* p) { *p = x; }, locate(*this, v));
+  if (v.kind == model_value::region && (v.name == "RL" || v.name == "Cm")) ++cv_parameter_version;
+}
+
+model gui_state::make_model(const std::vector<model_value>& targets, const std::vector<double>& values) {
+  return with_values(*this, targets, values, [&] { return make_model(false); });
+}
+
+variant_decor_fn gui_state::make_variant_decor(const std::vector<model_value>& targets) {
+  for (const auto& v: targets) locate(*this, v);
+  auto inputs = std::make_shared<decor_inputs>(decor_inputs{.presets=presets,
+                                                            .parameter_defaults=parameter_defaults,
+                                                            .locsets=locsets,
+                                                            .locset_defs=locset_defs,
+                                                            .detectors=detectors,
+                                                            .stimuli=stimuli,
+                                                            .regions=regions,
+                                                            .region_defs=region_defs,
+                                                            .parameter_defs=parameter_defs,
+                                                            .mechanisms=mechanisms,
+                                                            .ions=ions,
+                                                            .ion_defs=ion_defs,
+                                                            .ion_defaults=ion_defaults,
+                                                            .ion_par_defs=ion_par_defs,
+                                                            .cv_policy_def=cv_policy_def});
+  return [inputs, targets](const std::vector<double>& values) {
+    return with_values(*inputs, targets, values, [&] { return make_decor(*inputs); });
+  };
+}
+
+void gui_state::start_fitting() {
+  if (label_deadline || evaluating) concretise({}, {}, {});
+  fit.error.clear();
+  if (!fit.target)            { fit.error = "Pick a target trace."; return; }
+  if (fit.parameters.empty()) { fit.error = "Add parameters to fit."; return; }
+  std::vector<double> start;
+  try {
+    for (const auto& p: fit.parameters) start.push_back(get_value(p.value));
+  } catch (const std::exception& e) {
+    fit.error = e.what();
+    return;
+  }
+  fit.cma.emplace(fit.normalise(start), 0.3);
+  fit.best.clear();
+  fit.best_score = std::numeric_limits<double>::infinity();
+  fit.scores.clear();
+}
+
+void gui_state::poll_fitting() {
+  if (!fit.cma) return;
+  auto fail = [&](const std::string& message) {
+    log_warn("Parameter fit failed: {}", message);
+    fit.error = message;
+    fit.cma.reset();
+  };
+  if (fit.evaluating) {
+    if (!fit.evaluating->ready()) return;
+    auto done = std::move(fit.evaluating.value());
+    fit.evaluating.reset();
+    std::vector<double> scores;
+    try {
+      scores = done.get();
+    } catch (const task_cancelled&) {
+      fit.cma.reset();
+      return;
+    } catch (const std::exception& e) {
+      return fail(e.what());
+    }
+    auto best = std::min_element(scores.begin(), scores.end()) - scores.begin();
+    if (scores[best] < fit.best_score) {
+      fit.best_score = scores[best];
+      fit.best       = fit.denormalise(fit.population[best]);
+    }
+    fit.scores.push_back(fit.best_score);
+    fit.cma->tell(fit.population, scores);
+    if (fit.cma->generation >= size_t(fit.generations)) {
+      fit.cma.reset();
+      return;
+    }
+  }
+  // Next generation: one cell per candidate, all in one simulation
+  fit.population = fit.cma->ask();
+  std::vector<model_value> targets;
+  for (const auto& p: fit.parameters) targets.push_back(p.value);
+  std::vector<model> models;
+  try {
+    for (const auto& x: fit.population) models.push_back(make_model(targets, fit.denormalise(x)));
+  } catch (const std::exception& e) {
+    return fail(e.what());
+  }
+  fit.evaluating.emplace(std::vector<std::string>{"Simulating"},
+                         [models=std::move(models), until=sim.until, dt=sim.dt,
+                          objective=fit.objective, threshold=fit.threshold, target=fit.target.value()](task_progress& progress) {
+                           std::vector<double> result;
+                           for (const auto& run: run_batch(models, until, dt, progress)) result.push_back(fit_score(objective, threshold, target, run));
+                           return result;
+                         });
+}
+
+void gui_state::start_sensitivity() {
+  if (label_deadline || evaluating) concretise({}, {}, {});
+  sens.error.clear();
+  if (sens.probe.empty())    { sens.error = "Place a probe first."; return; }
+  if (sens.selected.empty()) { sens.error = "Pick parameters to vary."; return; }
+  std::vector<double> bases;
+  std::vector<model> models;
+  try {
+    for (const auto& v: sens.selected) bases.push_back(get_value(v));
+    for (const auto& x: sensitivity_variants(bases, sens.step)) models.push_back(make_model(sens.selected, x));
+  } catch (const std::exception& e) {
+    sens.error = e.what();
+    return;
+  }
+  sens.running_values = sens.selected;
+  sens.running_bases  = bases;
+  sens.running.emplace(std::vector<std::string>{"Simulating"},
+                       [models=std::move(models), until=sim.until, dt=sim.dt,
+                        key=sens.probe, threshold=sens.threshold](task_progress& progress) {
+                         std::vector<trace_features> result;
+                         for (const auto& run: run_batch(models, until, dt, progress)) result.push_back(measure_features(run, key, threshold));
+                         return result;
+                       });
+}
+
+void gui_state::start_ensemble() {
+  if (label_deadline || evaluating) concretise({}, {}, {});
+  ens.error.clear();
+  if (ens.parameters.empty()) { ens.error = "Add parameters to vary."; return; }
+  std::vector<model_value> targets;
+  for (const auto& p: ens.parameters) targets.push_back(p.value);
+  // Variants are drawn and built on the worker, batch by batch.
+  model base;
+  variant_decor_fn decor;
+  try {
+    base  = make_model(false);
+    decor = make_variant_decor(targets);
+  } catch (const std::exception& e) {
+    ens.error = e.what();
+    return;
+  }
+  std::vector<std::string> stages;
+  for (auto lo = 0; lo < ens.size; lo += ens.batch) stages.push_back(fmt::format("Variants {}-{}", lo + 1, std::min(lo + ens.batch, ens.size)));
+  ens.running.emplace(std::move(stages),
+                      [base=std::move(base), decor=std::move(decor), parameters=ens.parameters,
+                       size=size_t(ens.size), batch=size_t(ens.batch), seed=ens.seed, until=sim.until, dt=sim.dt](task_progress& progress) {
+                        return run_ensemble(base, decor, parameters, size, batch, seed, until, dt, progress);
+                      });
+}
+
+void gui_state::run_simulation() {
+  // Don't simulate with labels still waiting for evaluation.
+  if (label_deadline || evaluating) concretise({}, {}, {});
+  auto mdl = make_model();
+  auto rec = make_recipe(mdl.properties, arb::cable_cell(mdl.morph, mdl.decor, mdl.labels));
+  rec.probes = std::move(mdl.probes);
   // Make simulation
   auto sm = arb::simulation(rec);
+  // Streams traces to disk as they are sampled; index matches `sim.traces`.
+  // Set up before touching any state, so a bad directory leaves the last run as it was.
+  std::optional<trace_export> exporter;
+  if (sim.export_traces) {
+    auto dir = std::filesystem::path{sim.export_dir} / fmt::format("run-{}", run_number + 1);
+    try {
+      exporter.emplace(dir);
+    } catch (const std::exception& e) {
+      sim.error = e.what();
+      return;
+    }
+  }
+  sim.error.clear();
+  sim.exported_only.reset();
+  if (exporter && sim.export_only) sim.exported_only = exporter->directory().string();
+  // Keep the last run for comparison
+  auto parameters = describe_parameters();
+  auto changes    = run_number ? diff_parameters(run_params, parameters) : std::vector<run_change>{};
+  if (run_number) history.push(run_number, std::move(run_params), std::move(run_changes), std::move(sim.traces));
+  run_params  = std::move(parameters);
+  run_changes = std::move(changes);
+  ++run_number;
   sim.traces.clear();
   sim.tag_to_id.clear();
+  sim.trace_keys.clear();
+  sim.recording.reset();
+  sim.spikes.clear();
+  renderer.playback.active = false;
+  std::vector<float> times, values; // Staging for traces
+  std::unordered_map<std::string, id_type> probe_ids;
+  for (const auto& id: probes.idx_to_id) probe_ids[std::to_string(id.value)] = id;
+  sm.set_global_spike_callback([&](const std::vector<arb::spike>& spikes) { sim.spikes.append(spikes); });
   sm.add_sampler(arb::all_probes,
                  arb::regular_schedule(this->sim.dt * U::ms),
                  [&](const arb::probe_metadata pm, std::size_t n, const arb::sample_record* samples) {
-                    auto loc = arb::util::any_cast<const arb::mlocation*>(pm.meta);
                     auto tag = pm.id.tag;
-                    if (sim.tag_to_id.count(tag) == 0) {
-                      id_type id = {sim.traces.size()};
-                      sim.tag_to_id[tag] = id;
-                      sim.traces.emplace_back(tag, id, pm.index, loc->pos, loc->branch);
+                    if (tag == cell_tag) {
+                      auto& recording = sim.recording;
+                      if (!recording) recording = cell_recording{.kind=sim.record_cell, .cables=*arb::util::any_cast<const arb::mcable_list*>(pm.meta)};
+                      decode_samples(samples, n, recording->times, recording->values);
+                      return;
                     }
-                    auto id = sim.tag_to_id[tag];
-                    auto& t = sim.traces.at(id.value);
-                    for (std::size_t i = 0; i<n; ++i) {
-                      const double* value = arb::util::any_cast<const double*>(samples[i].data);
-                      t.times.push_back(samples[i].time);
-                      t.values.push_back(*value);
+                    auto loc = arb::util::any_cast<const arb::mlocation*>(pm.meta);
+                    // One trace per location
+                    auto key = fmt::format("{}/{}", tag, pm.index);
+                    if (sim.tag_to_id.count(key) == 0) {
+                      id_type id = {sim.traces.size()};
+                      sim.tag_to_id[key] = id;
+                      auto probe = probe_ids.at(tag);
+                      sim.traces.emplace_back(tag, id, probe, pm.index, loc->pos, loc->branch);
+                      sim.traces.back().data.compress = sim.compress_traces;
+                      if (exporter) {
+                        const auto& def = probes[probe];
+                        exporter->add({.probe=tag, .index=pm.index, .kind=def.kind, .variable=def.variable, .branch=loc->branch, .position=loc->pos});
+                      }
                     }
+                    auto& t = sim.traces.at(sim.tag_to_id[key].value);
+                    times.clear();
+                    values.clear();
+                    decode_samples(samples, n, times, values);
+                    if (exporter) exporter->write(t.id.value, times, values);
+                    if (!(exporter && sim.export_only)) t.data.append(times, values);
                   });
   try {
     sm.run(sim.until * U::ms, sim.dt * U::ms);
+    if (exporter) exporter->finish();
+    if (auto& recording = sim.recording; recording && !recording->values.empty()) {
+      auto [lo, hi] = std::minmax_element(recording->values.begin(), recording->values.end());
+      recording->lo = *lo;
+      recording->hi = *hi;
+      renderer.make_playback(builder.make_cable_map(recording->cables), recording->cables.size());
+      sim.play_time   = recording->times.front();
+      sim.play_sample = -1;
+    }
+  } catch (const std::exception& e) {
+    sim.error = fmt::format("Arbor failed to run: {}", e.what());
   } catch (...) {
-      ImGui::OpenPopup("Error");
-  }
-  if (ImGui::BeginPopupModal("Error")) {
-    ImGui::Text("Arbor failed to run.");
-    if (ImGui::Button("OK")) ImGui::CloseCurrentPopup();
-    ImGui::EndPopup();
+    sim.error = "Arbor failed to run.";
   }
+  for (const auto& [key, id]: sim.tag_to_id) sim.trace_keys.push_back(key);
+  std::sort(sim.trace_keys.begin(), sim.trace_keys.end());
 }
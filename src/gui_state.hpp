@@ -2,6 +2,8 @@
 
 #include <string>
 #include <filesystem>
+#include <map>
+#include <tuple>
 #include <unordered_set>
 #include <unordered_map>
 
@@ -14,9 +16,16 @@
 #include "geometry.hpp"
 #include "loader.hpp"
 #include "location.hpp"
+#include "region_index.hpp"
+#include "task.hpp"
 
 #include "ion.hpp"
 #include "cv_policy.hpp"
+#include "cv_tuner.hpp"
+#include "fitter.hpp"
+#include "sensitivity.hpp"
+#include "ensemble.hpp"
+#include "run_history.hpp"
 #include "parameter.hpp"
 #include "probe.hpp"
 #include "mechanism.hpp"
@@ -24,6 +33,39 @@
 #include "stimulus.hpp"
 #include "simulation.hpp"
 
+// Everything derived from a morphology file that can be computed off the render thread.
+struct prepared_morphology {
+    cell_builder builder;
+    mesh         cell_mesh;
+
+    std::vector<rg_def>                     regions;
+    std::vector<std::vector<arb::msegment>> region_segments;
+    std::vector<ls_def>                     locsets;
+    std::vector<std::vector<glm::vec3>>     locset_points;
+    std::vector<ie_def>                     iexprs;
+};
+
+// Labels picked for re-rendering together with their concrete geometry.
+struct label_update {
+    std::vector<id_type>                    regions;
+    std::vector<std::vector<arb::msegment>> region_segments;
+    std::vector<id_type>                    locsets;
+    std::vector<std::vector<glm::vec3>>     locset_points;
+    std::vector<id_type>                    iexprs;
+};
+
+// Labels concretised on a worker from a slim copy of the builder and the label
+// definitions; only applied if no edit happened in the meantime, ie
+// `generation` is still current. Definitions are taken back by id.
+struct label_evaluation {
+    size_t                   generation = 0;
+    cell_builder             builder;
+    component_unique<rg_def> region_defs;
+    component_unique<ls_def> locset_defs;
+    component_unique<ie_def> iexpr_defs;
+    label_update             update;
+};
+
 struct gui_state {
     arb::cable_cell_parameter_set   presets = arb::neuron_parameter_defaults;
     parameter_def                   parameter_defaults = {};
@@ -48,6 +90,7 @@ struct gui_state {
     component_unique<ion_def>       ion_defs;
     component_unique<ion_default>   ion_defaults;
     component_join<ion_parameter>   ion_par_defs;
+    std::vector<std::string>        ion_names; // Of `ions` in order, rebuilt after ion events
 
     bool open_morph_read = false;
     bool open_acc_read   = false;
@@ -62,11 +105,29 @@ struct gui_state {
     float auto_omega     = 0.5f;
 
     simulation sim;
+    // Earlier runs, and what changed since the one before
+    run_history history;
+    size_t run_number = 0;
+    run_parameters run_params;
+    std::vector<run_change> run_changes;
+    fitter fit;
+    sensitivity sens;
+    ensemble ens;
 
     cv_def      cv_policy_def;
+    // Discretisations by (policy, label version, Ra, Cm, per region RL and Cm), made off-thread.
+    using cv_key = std::tuple<std::string, size_t, double, double,
+                              std::vector<std::tuple<id_type, std::optional<double>, std::optional<double>>>>;
+    std::map<cv_key, cv_discretisation> discretisations;
+    std::optional<task<cv_discretisation>> discretising;
+    cv_key discretising_key;
+    cv_key shown_cv_key; // Of the statistics in the CV policy panel
+    // Bumped when RL or Cm change; the statistics are redone once it moves past the shown one.
+    size_t cv_parameter_version = 0, shown_cv_version = 0;
+    cv_tuner tuner;
 
     // TODO This probably belongs into geometry, but that does not know about regions (yet).
-    std::unordered_map<size_t, std::unordered_set<id_type>> segment_to_regions;
+    region_index region_members;
     std::optional<object_id> object;
 
     bool shutdown_requested = false;
@@ -75,9 +136,30 @@ struct gui_state {
     file_chooser_state acc_chooser;
     file_chooser_state cat_chooser;
     std::string open_cat_name;
+    bool watch_cat = false;
+
+    // External catalogues; watched ones are reloaded once their file changes.
+    struct catalogue_source {
+        std::string name;
+        std::filesystem::path path;
+        std::filesystem::file_time_type mtime;
+        bool watch = false;
+    };
+    std::vector<catalogue_source> catalogue_sources;
+    std::optional<task<loaded_catalogue>> loading_cat;
+    std::optional<timer::time_point> next_cat_check;
+    std::string catalogue_error;
 
     view_state view;
 
+    std::optional<task<prepared_morphology>> loading;
+
+    // Edited labels are parsed at once, but concretised off-thread after typing pauses.
+    std::vector<id_type> edited_regions, edited_locsets, edited_iexprs;
+    std::optional<timer::time_point> label_deadline;
+    size_t label_generation = 0;
+    std::optional<task<label_evaluation>> evaluating;
+
     gui_state(const gui_state&) = delete;
     gui_state();
 
@@ -86,8 +168,46 @@ struct gui_state {
     std::string snapshot_path = std::filesystem::current_path() / "snapshot.png";
 
     void reload(const io::loaded_morphology&);
+    void start_load(const std::filesystem::path& fn, const io::load_fn& load);
+    void finish_load(prepared_morphology&&);
+    void start_load_catalogue(const std::string& name, const std::filesystem::path& fn);
+    void poll_catalogues();
+
+    id_type insert_region(const rg_def&);
+    id_type insert_locset(const ls_def&);
+    id_type insert_iexpr(const ie_def&);
+    void    set_region_segments(const id_type&, const std::vector<arb::msegment>&);
+    // Rebuild the label dictionary once, then concretise and render the given labels.
+    void    concretise(const std::vector<id_type>& regions,
+                       const std::vector<id_type>& locsets,
+                       const std::vector<id_type>& iexprs);
+    void    render_labels(const label_update&);
+    // Restart the debounce timer and invalidate evaluations in flight.
+    void    touch_labels();
+    // Start a pending evaluation once the debounce expired, apply finished ones.
+    void    poll_labels();
 
     void run_simulation();
+    // Copy of the cell, parameters, and probes for runs off the render thread;
+    // the cell-wide probe only with `cell_wide`.
+    model make_model(bool cell_wide=true);
+    // Flat name -> value listing of the settings, to diff runs.
+    run_parameters describe_parameters();
+    // Numbers of the model that can be fitted or varied, with their current values.
+    std::vector<std::pair<model_value, double>> model_values();
+    double get_value(const model_value&);
+    void   set_value(const model_value&, double);
+    // Model with `values` in place of the current settings of `targets`, without the cell-wide probe.
+    model  make_model(const std::vector<model_value>& targets, const std::vector<double>& values);
+    // Decors with other values for `targets`, made from a copy of the settings taken now.
+    variant_decor_fn make_variant_decor(const std::vector<model_value>& targets);
+    void start_fitting();
+    void poll_fitting();
+    void start_sensitivity();
+    void start_ensemble();
+    void start_cv_tuning();
+    // Upload the recorded sample at `sim.play_time` to the renderer, if it changed.
+    void update_playback();
 
     void serialize(const std::filesystem::path& fn);
     void deserialize(const std::filesystem::path& fn);
@@ -117,10 +237,19 @@ struct gui_state {
     void update_locset(const id_type& def) { update_locdef<ls_def>(def); }
     void update_iexpr(const id_type& def) { update_locdef<ie_def>(def); }
     void update_cv_policy() { events.push_back(evt_upd_cv{}); }
+    void make_cv_boundaries();
+    void show_cv_boundaries();
+    void poll_cv_boundaries();
+    cv_key current_cv_key() const;
 
     bool store_snapshot();
     void update();
     void reset();
     void gui();
     void handle_keys();
+
+    // Whether frames change without input, eg auto-rotation or a progress bar.
+    bool animating() const;
+    // Earliest point a frame is due without input, eg to flush edited labels.
+    std::optional<timer::time_point> next_deadline() const;
 };
@@ -17,6 +17,7 @@ const char * icon_target   = (const char *)ICON_FK_CROSSHAIRS;
 const char * icon_show     = (const char *)ICON_FK_EYE;
 const char * icon_hide     = (const char *)ICON_FK_EYE_SLASH;
 const char * icon_refresh  = (const char *)ICON_FK_REFRESH;
+const char * icon_search   = (const char *)ICON_FK_SEARCH;
 const char * icon_folder   = (const char *)ICON_FK_FOLDER;
 const char * icon_open_dir = (const char *)ICON_FK_FOLDER_OPEN;
 const char * icon_gear     = (const char *)ICON_FK_COG;
@@ -5,7 +5,8 @@
 #include <vector>
 
 struct id_type {
-    std::size_t value;
+    std::size_t value;          // Slot, reused after deletion
+    std::size_t generation = 0; // Bumped each time the slot is reused
     auto operator<=>(const id_type&) const = default;
 };
 
@@ -30,7 +31,7 @@ namespace std {
     }
 
     template<> struct hash<id_type> {
-        std::size_t operator()(const id_type& k) const { return std::hash<decltype(k.value)>{}(k.value); }
+        std::size_t operator()(const id_type& k) const { return combine_all0(k.value, k.generation); }
     };
 
     template<typename A, typename B> struct hash<std::pair<A, B>> {
@@ -6,7 +6,7 @@ void gui_ion_parameter(id_type id,
                        const ion_def& def, ion_parameter& data,
                        const ion_default& fallback, const std::unordered_map<std::string, arb::cable_cell_ion_data>& preset) {
     with_id guard{id};
-    auto name = def.name;
+    const auto& name = def.name;
     if (gui_tree(name)) {
         with_item_width width{120.0f};
         if (preset.contains(name)) {
@@ -30,7 +30,7 @@ void gui_ion_default(id_type id, ion_def& definition, ion_default& data, const s
     with_item_width item_width{120.0f};
     auto open = gui_tree("##ion-tree");
     ImGui::SameLine();
-    ImGui::InputText("##ion-name", &definition.name, ImGuiInputTextFlags_AutoSelectAll);
+    if (ImGui::InputText("##ion-name", &definition.name, ImGuiInputTextFlags_AutoSelectAll)) evts.push_back(evt_upd_ion{id});
     gui_right_margin();
     if (ImGui::Button(icon_delete)) evts.push_back(evt_del_ion{id});
     if (open) {
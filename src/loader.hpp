@@ -3,6 +3,8 @@
 #include <vector>
 #include <string>
 #include <filesystem>
+#include <functional>
+#include <optional>
 
 #include <arbor/morph/morphology.hpp>
 
@@ -25,9 +27,11 @@ loaded_morphology load_asc(const std::filesystem::path&);
 const std::vector<std::string>& get_suffixes();
 const std::vector<std::string>& get_flavors(const std::string& suffix);
 
+using load_fn = std::function<loaded_morphology(const std::filesystem::path&)>;
+
 struct loader_state {
     std::string message;
-    std::optional<std::function<loaded_morphology(const std::filesystem::path&)>> load;
+    std::optional<load_fn> load;
 };
 
 loader_state get_loader(const std::string& extension, const std::string& flavor);
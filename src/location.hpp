@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include <glm/glm.hpp>
 
@@ -15,8 +16,8 @@
 
 struct iexpr_info {
     float min = std::numeric_limits<float>::max();
-    float max = std::numeric_limits<float>::min();
-    std::unordered_map<unsigned, std::pair<float, float>> values;
+    float max = std::numeric_limits<float>::lowest();
+    std::vector<std::pair<float, float>> values; // Normalised (proximal, distal) values by segment id
 };
 
 struct ie_def {
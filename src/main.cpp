@@ -5,29 +5,46 @@
 #include <chrono>
 #include <thread>
 
+// Longest sleep while idle; bounds the latency of timed work like rescanning directories.
+constexpr auto idle_time = std::chrono::seconds(1);
+// Frames rendered at full rate after input, lets ImGui settle hover states and layout.
+constexpr int settle_frames = 3;
+
 int main(int, char**) {
     log_init();
     log_info("Rendering locked to {} us/frame", to_us(frame_time));
 
     Window window{};
     gui_state state{};
+    task_done_hook = Window::wake;
 
-    for (;window.running() && !state.shutdown_requested;) {
+    for (int busy = settle_frames; window.running() && !state.shutdown_requested;) {
         if (!window.visible()) {
             log_debug("Pausing for events.");
-            glfwWaitEvents();
+            window.wait(std::chrono::duration<double>(idle_time).count());
             continue;
         }
+        if (busy <= 0 && !state.animating()) {
+            auto t0 = timer::now();
+            auto until = t0 + idle_time;
+            if (auto deadline = state.next_deadline(); deadline) until = std::min(until, *deadline);
+            window.wait(std::max(0.0, std::chrono::duration<double>(until - t0).count()));
+            // Woken early means input or a finished task; timeouts only need a single frame.
+            if (timer::now() < until) busy = settle_frames;
+        }
         auto t0 = timer::now();
         window.begin_frame();
         state.gui();
         window.end_frame();
+        busy = window.interacting() ? settle_frames : busy - 1;
         {
             auto t1 = timer::now();
             auto dt = t1 - t0;
             log_debug("Frame took {} us", to_us(dt));
             if (dt < frame_time) std::this_thread::sleep_for(frame_time - dt);
-            auto t2 = timer::now();
         }
     }
+    // Workers must not wake the window or outlive the state once we return.
+    task_done_hook = nullptr;
+    all_tasks.join();
 }
@@ -1,5 +1,9 @@
 #include "mechanism.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <tuple>
+
 #include <fmt/format.h>
 
 #include "utils.hpp"
@@ -7,23 +11,120 @@
 
 std::unordered_map<std::string, arb::mechanism_catalogue> catalogues = default_catalogues;
 
+namespace {
+    size_t catalogues_version = 0;
+    catalogue_index meta_index;
+
+    void rebuild_index() {
+        meta_index = {};
+        meta_index.version = catalogues_version;
+        for (const auto& [cat_name, cat]: catalogues) {
+            meta_index.names.push_back(cat_name);
+            meta_index.merged.extend(cat, cat_name + "::");
+            for (const auto& name: cat.mechanism_names()) {
+                auto info = cat[name];
+                auto& meta = meta_index.mechanisms.emplace_back(mechanism_meta{.cat=cat_name, .name=name, .kind=info.kind});
+                for (const auto& [k, v]: info.globals)    meta.globals.emplace_back(k, v.default_value);
+                for (const auto& [k, v]: info.parameters) meta.parameters.emplace_back(k, v.default_value);
+                for (const auto& [k, v]: info.state) {
+                    meta.states.emplace_back(k, v.default_value);
+                    meta_index.state_vars.push_back(fmt::format("{}::{}::{}", cat_name, name, k));
+                }
+                for (const auto& [k, v]: info.ions) meta.ions.push_back(k);
+                std::sort(meta.ions.begin(), meta.ions.end());
+            }
+        }
+        std::sort(meta_index.names.begin(), meta_index.names.end());
+        std::sort(meta_index.mechanisms.begin(), meta_index.mechanisms.end(),
+                  [](const auto& l, const auto& r) { return std::tie(l.cat, l.name) < std::tie(r.cat, r.name); });
+        std::sort(meta_index.state_vars.begin(), meta_index.state_vars.end());
+        log_debug("Indexed {} mechanisms in {} catalogues", meta_index.mechanisms.size(), meta_index.names.size());
+    }
+}
+
+void add_catalogue(const std::string& name, const arb::mechanism_catalogue& cat) {
+    catalogues[name] = cat;
+    ++catalogues_version;
+}
+
+void reset_catalogues() {
+    catalogues = default_catalogues;
+    ++catalogues_version;
+}
+
+const catalogue_index& catalogue_meta() {
+    if (meta_index.version != catalogues_version) rebuild_index();
+    return meta_index;
+}
+
+const mechanism_meta* catalogue_index::find(const std::string& cat, const std::string& name) const {
+    auto it = std::lower_bound(mechanisms.begin(), mechanisms.end(), std::tie(cat, name),
+                               [](const auto& l, const auto& r) { return std::tie(l.cat, l.name) < r; });
+    if (it == mechanisms.end() || it->cat != cat || it->name != name) return nullptr;
+    return &*it;
+}
+
+loaded_catalogue load_catalogue(const std::string& name,
+                                const std::filesystem::path& fn,
+                                const std::vector<std::string>& ions,
+                                task_progress& progress) {
+    progress.enter(0);
+    auto result = loaded_catalogue{.name=name, .path=fn, .mtime=std::filesystem::last_write_time(fn)};
+    // The dynamic loader hands out the already mapped library for a known path,
+    // so load a private copy to pick up a rebuilt one. It is unlinked right away;
+    // the mapping stays valid.
+    static std::atomic<size_t> serial = 0;
+    auto tmp = std::filesystem::temp_directory_path() / fmt::format("arbor-gui-{}-{}{}", name, serial++, fn.extension().string());
+    std::filesystem::copy_file(fn, tmp, std::filesystem::copy_options::overwrite_existing);
+    try {
+        result.catalogue = arb::load_catalogue(tmp.string());
+    } catch (...) {
+        std::filesystem::remove(tmp);
+        throw;
+    }
+    std::filesystem::remove(tmp);
+
+    progress.enter(1);
+    auto names = result.catalogue.mechanism_names();
+    if (names.empty()) log_error("Catalogue {} contains no mechanisms.", fn.string());
+    for (auto ix = 0ul; ix < names.size(); ++ix) {
+        progress.advance(ix, names.size());
+        const auto& mech = names[ix];
+        auto info = result.catalogue[mech];
+        switch (info.kind) {
+            case arb_mechanism_kind_density:
+            case arb_mechanism_kind_point:
+            case arb_mechanism_kind_voltage:
+            case arb_mechanism_kind_reversal_potential:
+            case arb_mechanism_kind_gap_junction:
+                break;
+            default:
+                log_error("Mechanism {} has unknown kind {}.", mech, int(info.kind));
+        }
+        for (const auto& [ion, dep]: info.ions) {
+            if (std::find(ions.begin(), ions.end(), ion) != ions.end()) continue;
+            result.warnings.push_back(fmt::format("Mechanism {} uses undefined ion '{}'.", mech, ion));
+        }
+    }
+    return result;
+}
+
 void make_mechanism(mechanism_def& data,
                     const std::string& cat_name, const std::string& name,
                     const std::unordered_map<std::string, double>& values) {
     if (name.empty()) log_error("Empty mechanism name. Selector must be 'cat::mech'.");
     data.name = name;
     data.cat  = cat_name;
-    if (!catalogues.contains(data.cat)) log_error(fmt::format("Unknown catalogue: {}", data.cat));
-    auto cat = catalogues[data.cat];
-    if (!cat.has(data.name)) log_error(fmt::format("Unknown mechanism {} in catalogue {}", data.name, data.cat));
-    auto info = cat[data.name];
+    if (!catalogues.contains(data.cat)) log_error("Unknown catalogue: {}", data.cat);
+    const auto* info = catalogue_meta().find(data.cat, data.name);
+    if (!info) log_error("Unknown mechanism {} in catalogue {}", data.name, data.cat);
     data.globals.clear();
     data.parameters.clear();
     data.states.clear();
     log_debug("Setting values");
-    for (const auto& [k, v]: info.globals)    data.globals[k]    = values.contains(k) ? values.at(k) : v.default_value;
-    for (const auto& [k, v]: info.parameters) data.parameters[k] = values.contains(k) ? values.at(k) : v.default_value;
-    for (const auto& [k, v]: info.state)      data.states[k]     = values.contains(k) ? values.at(k) : v.default_value;
+    for (const auto& [k, v]: info->globals)    data.globals[k]    = values.contains(k) ? values.at(k) : v;
+    for (const auto& [k, v]: info->parameters) data.parameters[k] = values.contains(k) ? values.at(k) : v;
+    for (const auto& [k, v]: info->states)     data.states[k]     = values.contains(k) ? values.at(k) : v;
 }
 
 void gui_mechanism(id_type id, mechanism_def& data, const std::vector<ie_def>& ies, event_queue& evts) {
@@ -31,12 +132,15 @@ void gui_mechanism(id_type id, mechanism_def& data, const std::vector<ie_def>& i
     auto open = gui_tree("##mechanism-tree");
     ImGui::SameLine();
     if (ImGui::BeginCombo("##mechanism-choice", data.name.c_str())) {
-        for (const auto& [cat_name, cat]: catalogues) {
+        const auto& meta = catalogue_meta();
+        for (const auto& cat_name: meta.names) {
             ImGui::Selectable(cat_name.c_str(), false);
             with_indent ind{};
-            for (const auto& name: cat.mechanism_names()) {
-                if (cat[name].kind != arb_mechanism_kind_density) continue;
-                if (gui_select(fmt::format("  {}##{}", name, cat_name), data.name)) make_mechanism(data, cat_name, name);
+            auto it = std::lower_bound(meta.mechanisms.begin(), meta.mechanisms.end(), cat_name,
+                                       [](const auto& l, const auto& r) { return l.cat < r; });
+            for (; it != meta.mechanisms.end() && it->cat == cat_name; ++it) {
+                if (it->kind != arb_mechanism_kind_density) continue;
+                if (gui_select(frame_format("  {}##{}", it->name, cat_name), data.name)) make_mechanism(data, cat_name, it->name);
             }
         }
         ImGui::EndCombo();
@@ -62,13 +166,14 @@ void gui_mechanism(id_type id, mechanism_def& data, const std::vector<ie_def>& i
                     with_id id(k);
                     with_item_width iw(80.0f);
                     auto none = data.scales.contains(k);
-                    auto lbl  = data.scales[k].value_or("-");
-                    if (ImGui::BeginCombo("Scale", lbl.c_str())) {
-                        if (ImGui::Selectable("-", lbl == "-")) data.scales[k] = {};
+                    const auto& scale = data.scales[k];
+                    const char* lbl   = scale ? scale->c_str() : "-";
+                    if (ImGui::BeginCombo("Scale", lbl)) {
+                        if (ImGui::Selectable("-", !scale)) data.scales[k] = {};
                         for (const auto& ie: ies) {
                             if (ie.state != def_state::good) continue;
                             auto& nm = ie.name;
-                            if (ImGui::Selectable(nm.c_str(), nm == lbl)) data.scales[k] = nm;
+                            if (ImGui::Selectable(nm.c_str(), scale == nm)) data.scales[k] = nm;
                         }
                         ImGui::EndCombo();
                     }
@@ -3,11 +3,14 @@
 #include <unordered_map>
 #include <string>
 #include <compare>
+#include <filesystem>
+#include <vector>
 
 #include <arbor/mechcat.hpp>
 
 #include "component.hpp"
 #include "events.hpp"
+#include "task.hpp"
 
 struct mechanism_def {
     std::string name = "";
@@ -29,8 +32,52 @@ inline bool operator==(const mechanism_def& l, const mechanism_def& r) {
 static const std::unordered_map<std::string, arb::mechanism_catalogue> default_catalogues = {{"default", arb::global_default_catalogue()},
                                                                                              {"allen",   arb::global_allen_catalogue()},
                                                                                              {"BBP",     arb::global_bbp_catalogue()}};
+// Only modify through `add_catalogue` and `reset_catalogues`, so the index is kept up to date.
 extern std::unordered_map<std::string, arb::mechanism_catalogue> catalogues;
 
+void add_catalogue(const std::string& name, const arb::mechanism_catalogue& cat);
+void reset_catalogues();
+
+// Flat copy of a mechanism's metadata; looking up `arb::mechanism_info` copies it every time.
+struct mechanism_meta {
+    std::string cat  = "";
+    std::string name = "";
+    arb_mechanism_kind kind = arb_mechanism_kind_density;
+    std::vector<std::pair<std::string, double>> globals    = {}; // name and default value
+    std::vector<std::pair<std::string, double>> parameters = {};
+    std::vector<std::pair<std::string, double>> states     = {};
+    std::vector<std::string> ions = {};
+};
+
+// Metadata of all catalogues, rebuilt when `catalogues` changes.
+struct catalogue_index {
+    size_t version = -1;
+    std::vector<std::string> names;        // Catalogue names, sorted
+    std::vector<mechanism_meta> mechanisms; // Sorted by (catalogue, mechanism)
+    std::vector<std::string> state_vars;   // All 'cat::mech::state', sorted
+    arb::mechanism_catalogue merged;       // Union of all catalogues, prefixed by 'cat::'
+
+    const mechanism_meta* find(const std::string& cat, const std::string& name) const;
+};
+
+const catalogue_index& catalogue_meta();
+
+// A catalogue loaded from a shared object and checked off the render thread.
+struct loaded_catalogue {
+    std::string name = "";
+    std::filesystem::path path = "";
+    std::filesystem::file_time_type mtime = {};
+    arb::mechanism_catalogue catalogue;
+    std::vector<std::string> warnings = {}; // Usable, but probably not what was intended
+};
+
+// Throws on unreadable or empty catalogues and on mechanisms of unknown kind.
+// Ions outside `ions` only produce warnings, they can be added later.
+loaded_catalogue load_catalogue(const std::string& name,
+                                const std::filesystem::path& fn,
+                                const std::vector<std::string>& ions,
+                                task_progress& progress);
+
 void make_mechanism(mechanism_def& data,
                     const std::string& cat_name, const std::string& name,
                     const std::unordered_map<std::string, double>& values={});
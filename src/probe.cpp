@@ -15,7 +15,9 @@ void gui_probe(const id_type& id, probe_def& data, event_queue& evts,
     with_indent indent{ImGui::GetTreeNodeToLabelSpacing()};
     gui_choose("Kind", data.kind, probe_def::kinds);
     if ((data.kind == "Membrane Current") || (data.kind == "Internal Concentration") || (data.kind == "External Concentration")) {
-        if (ImGui::BeginCombo("Ion Species", data.variable.c_str())) {
+        auto total = data.kind == "Membrane Current";
+        if (ImGui::BeginCombo("Ion Species", (total && data.variable.empty()) ? "All" : data.variable.c_str())) {
+            if (total && ImGui::Selectable("All", data.variable.empty())) data.variable.clear();
             for (const auto& name: ion_names) {
                 if (ImGui::Selectable(name.c_str(), name == data.variable)) data.variable = name;
             }
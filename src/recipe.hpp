@@ -30,3 +30,16 @@ recipe make_recipe(const arb::cable_cell_global_properties& properties,
     result.cell       = cell;
     return result;
 }
+
+// Variants of one cell, the same probes on each; used to run many candidates as one simulation.
+struct batch_recipe: arb::recipe {
+    std::vector<arb::cable_cell> cells;
+    std::vector<arb::probe_info> probes;
+    arb::cable_cell_global_properties properties;
+
+    arb::cell_size_type num_cells() const override { return cells.size(); }
+    arb::cell_kind get_cell_kind(arb::cell_gid_type) const override { return arb::cell_kind::cable; }
+    arb::util::unique_any get_cell_description(arb::cell_gid_type gid) const override { return {cells.at(gid)}; }
+    std::vector<arb::probe_info> get_probes(arb::cell_gid_type) const override { return probes; }
+    std::any get_global_properties(arb::cell_kind) const override { return properties; }
+};
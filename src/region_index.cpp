@@ -0,0 +1,80 @@
+#include "region_index.hpp"
+
+#include <algorithm>
+#include <bit>
+
+size_t segment_set::count() const {
+    size_t result = 0;
+    for (auto word: words) result += std::popcount(word);
+    return result;
+}
+
+size_t count_common(const segment_set& a, const segment_set& b) {
+    size_t result = 0;
+    auto n = std::min(a.words.size(), b.words.size());
+    for (auto ix = 0ul; ix < n; ++ix) result += std::popcount(a.words[ix] & b.words[ix]);
+    return result;
+}
+
+void region_index::set(const id_type& region, segment_set&& segments) {
+    if (members.contains(region)) {
+        std::swap(members[region], segments);
+    } else {
+        members.add(region, std::move(segments));
+    }
+    touch();
+}
+
+void region_index::erase(const id_type& region) {
+    if (!members.contains(region)) return;
+    members.del(region);
+    touch();
+}
+
+void region_index::clear() {
+    members.clear();
+    touch();
+}
+
+std::vector<id_type> region_index::regions_at(size_t segment) {
+    if (dirty) {
+        auto n_segments = 0ul;
+        for (const auto& bits: members.items) n_segments = std::max(n_segments, 64*bits.words.size());
+        n_words = (members.items.size() + 63)/64;
+        transposed.assign(n_segments*n_words, 0);
+        for (auto rx = 0ul; rx < members.items.size(); ++rx) {
+            const auto& words = members.items[rx].words;
+            for (auto wx = 0ul; wx < words.size(); ++wx) {
+                for (auto word = words[wx]; word; word &= word - 1) {
+                    auto sx = 64*wx + std::countr_zero(word);
+                    transposed[sx*n_words + rx/64] |= std::uint64_t{1} << (rx % 64);
+                }
+            }
+        }
+        dirty = false;
+    }
+    std::vector<id_type> result;
+    if (segment*n_words >= transposed.size()) return result;
+    for (auto wx = 0ul; wx < n_words; ++wx) {
+        for (auto word = transposed[segment*n_words + wx]; word; word &= word - 1) {
+            result.push_back(members.idx_to_parent[64*wx + std::countr_zero(word)]);
+        }
+    }
+    return result;
+}
+
+const std::vector<region_overlap>& region_index::overlaps() {
+    if (overlaps_dirty) {
+        overlap_cache.clear();
+        const auto& items = members.items;
+        for (auto ix = 0ul; ix < items.size(); ++ix) {
+            for (auto jx = ix + 1; jx < items.size(); ++jx) {
+                if (auto n = count_common(items[ix], items[jx]); n > 0) {
+                    overlap_cache.push_back({members.idx_to_parent[ix], members.idx_to_parent[jx], n});
+                }
+            }
+        }
+        overlaps_dirty = false;
+    }
+    return overlap_cache;
+}
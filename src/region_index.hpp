@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "component.hpp"
+
+// Dense bitset over segment ids.
+struct segment_set {
+    std::vector<std::uint64_t> words;
+
+    void set(size_t ix) {
+        if (ix/64 >= words.size()) words.resize(ix/64 + 1, 0);
+        words[ix/64] |= std::uint64_t{1} << (ix % 64);
+    }
+    bool test(size_t ix) const { return ix/64 < words.size() && (words[ix/64] >> (ix % 64)) & 1; }
+    size_t count() const;
+};
+
+size_t count_common(const segment_set&, const segment_set&);
+
+struct region_overlap {
+    id_type a, b;
+    size_t segments;
+};
+
+// Which segments belong to which region: one bitset per region, plus the
+// transpose (one bitset over regions per segment), rebuilt on demand.
+struct region_index {
+    component_unique<segment_set> members;
+
+    void set(const id_type& region, segment_set&& segments);
+    void erase(const id_type& region);
+    void clear();
+
+    // Regions containing `segment`.
+    std::vector<id_type> regions_at(size_t segment);
+    // All pairs of regions sharing segments.
+    const std::vector<region_overlap>& overlaps();
+
+private:
+    bool dirty = true;
+    size_t n_words = 0;                       // Words per row of `transposed`
+    std::vector<std::uint64_t> transposed;    // Segment -> bits over indices into `members`
+    bool overlaps_dirty = true;
+    std::vector<region_overlap> overlap_cache;
+
+    void touch() { dirty = overlaps_dirty = true; }
+};
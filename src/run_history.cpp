@@ -0,0 +1,224 @@
+#include "run_history.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <ranges>
+
+#include <unistd.h>
+
+#include <fmt/format.h>
+#include <imgui.h>
+
+#include "gui.hpp"
+#include "icons.hpp"
+#include "utils.hpp"
+
+std::vector<run_change> diff_parameters(const run_parameters& before, const run_parameters& after) {
+    std::vector<run_change> result;
+    auto lhs = before.begin(), rhs = after.begin();
+    while (lhs != before.end() || rhs != after.end()) {
+        if (rhs == after.end() || (lhs != before.end() && lhs->first < rhs->first)) {
+            result.push_back({lhs->first, lhs->second, ""});
+            ++lhs;
+        } else if (lhs == before.end() || rhs->first < lhs->first) {
+            result.push_back({rhs->first, "", rhs->second});
+            ++rhs;
+        } else {
+            if (lhs->second != rhs->second) result.push_back({lhs->first, lhs->second, rhs->second});
+            ++lhs; ++rhs;
+        }
+    }
+    return result;
+}
+
+size_t past_run::bytes() const {
+    size_t result = 0;
+    for (const auto& trace: traces) result += trace.bytes();
+    return result;
+}
+
+run_history::run_history() {
+    std::error_code ec;
+    auto tmp = std::filesystem::temp_directory_path(ec);
+    if (ec) tmp = ".";
+    spill_dir = tmp / fmt::format("arbor-gui-runs-{}", getpid());
+}
+
+run_history::~run_history() {
+    std::error_code ec;
+    std::filesystem::remove_all(spill_dir, ec);
+}
+
+void run_history::push(size_t number, run_parameters parameters, std::vector<run_change> changes, std::vector<trace>&& traces) {
+    auto& run = runs.emplace_back();
+    run.number     = number;
+    run.parameters = std::move(parameters);
+    run.changes    = std::move(changes);
+    run.last_used  = ++tick;
+    for (auto& trace: traces) {
+        run.keys[{trace.probe, trace.index}] = run.traces.size();
+        run.traces.push_back(std::move(trace.data));
+    }
+    traces.clear();
+    while (runs.size() > std::max<size_t>(capacity, 1)) {
+        std::error_code ec;
+        if (runs.front().spilled) std::filesystem::remove(runs.front().spilled.value(), ec);
+        runs.erase(runs.begin());
+    }
+    enforce_budget(&runs.back());
+}
+
+void run_history::poll() {
+    ++frame;
+    if (!restoring || !restoring->ready()) return;
+    auto done = std::move(restoring.value());
+    restoring.reset();
+    auto run = std::find_if(runs.begin(), runs.end(), [&](const auto& r) { return r.number == restoring_number; });
+    if (run == runs.end() || !run->spilled) return; // Dropped meanwhile
+    auto fn = run->spilled.value();
+    try {
+        run->traces = done.get();
+        log_debug("Restored run {} from {}", run->number, fn.string());
+    } catch (const std::exception& e) {
+        log_warn("Could not read back run {} from {}; dropping its traces: {}", run->number, fn.string(), e.what());
+        run->keys.clear();
+        for (auto& trace: run->traces) trace.clear();
+    }
+    run->spilled.reset();
+    std::error_code ec;
+    std::filesystem::remove(fn, ec);
+    enforce_budget(&*run);
+}
+
+const trace_store* run_history::find(past_run& run, const id_type& probe, size_t index) {
+    auto it = run.keys.find({probe, index});
+    if (it == run.keys.end()) return nullptr;
+    run.last_used = ++tick;
+    run.frame     = frame;
+    if (run.spilled) {
+        if (!restoring) restore(run);
+        return nullptr;
+    }
+    return &run.traces.at(it->second);
+}
+
+void run_history::clear() {
+    restoring.reset();
+    std::error_code ec;
+    for (const auto& run: runs) {
+        if (run.spilled) std::filesystem::remove(run.spilled.value(), ec);
+    }
+    runs.clear();
+}
+
+size_t run_history::bytes() const {
+    size_t result = 0;
+    for (const auto& run: runs) result += run.bytes();
+    return result;
+}
+
+void run_history::enforce_budget(const past_run* keep) {
+    for (auto total = bytes(); total > budget;) {
+        past_run* victim = nullptr;
+        for (auto& run: runs) {
+            if (&run == keep || run.spilled || run.traces.empty() || run.frame + 1 >= frame) continue;
+            if (!victim || run.last_used < victim->last_used) victim = &run;
+        }
+        if (!victim) break;
+        auto size = victim->bytes();
+        // Disk unavailable; stay over budget rather than retry every call
+        if (!spill(*victim)) break;
+        total -= size;
+    }
+}
+
+// Layout per trace: compress flag (u8), sample count (u64), times, values; in the order of `traces`.
+bool run_history::spill(past_run& run) {
+    std::error_code ec;
+    std::filesystem::create_directories(spill_dir, ec);
+    if (ec) {
+        log_warn("Could not create {}: {}; keeping run {} in memory.", spill_dir.string(), ec.message(), run.number);
+        return false;
+    }
+    auto fn = spill_dir / fmt::format("run-{}.bin", run.number);
+    std::ofstream out(fn, std::ios::binary | std::ios::trunc);
+    std::vector<float> times, values;
+    for (const auto& trace: run.traces) {
+        trace.copy(times, values);
+        std::uint8_t compress = trace.compress;
+        std::uint64_t count   = times.size();
+        out.write(reinterpret_cast<const char*>(&compress), sizeof(compress));
+        out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        out.write(reinterpret_cast<const char*>(times.data()), count*sizeof(float));
+        out.write(reinterpret_cast<const char*>(values.data()), count*sizeof(float));
+    }
+    if (!out) {
+        log_warn("Could not spill run {} to {}; keeping it in memory.", run.number, fn.string());
+        std::filesystem::remove(fn, ec);
+        return false;
+    }
+    log_debug("Spilled run {} to {}", run.number, fn.string());
+    run.spilled = fn;
+    for (auto& trace: run.traces) trace.clear();
+    return true;
+}
+
+// Read back on a worker; the run keeps its empty stores until `poll` swaps them in.
+void run_history::restore(past_run& run) {
+    restoring_number = run.number;
+    restoring.emplace(std::vector<std::string>{"Reading"},
+                      [fn=run.spilled.value(), n=run.traces.size()](task_progress&) {
+                          std::ifstream in(fn, std::ios::binary);
+                          std::vector<trace_store> result(n);
+                          std::vector<float> times, values;
+                          for (auto ix = 0ul; ix < result.size(); ++ix) {
+                              std::uint8_t flag   = 0;
+                              std::uint64_t count = 0;
+                              in.read(reinterpret_cast<char*>(&flag), sizeof(flag));
+                              in.read(reinterpret_cast<char*>(&count), sizeof(count));
+                              times.resize(count);
+                              values.resize(count);
+                              in.read(reinterpret_cast<char*>(times.data()), count*sizeof(float));
+                              in.read(reinterpret_cast<char*>(values.data()), count*sizeof(float));
+                              if (!in) log_error("Short read at trace {}", ix);
+                              result[ix].compress = flag;
+                              result[ix].append(times, values);
+                          }
+                          return result;
+                      });
+}
+
+namespace {
+    void gui_changes(const std::vector<run_change>& changes) {
+        if (changes.empty()) {
+            ImGui::TextUnformatted("No changes.");
+            return;
+        }
+        for (const auto& [name, before, after]: changes) {
+            ImGui::Text("%s: %s -> %s", name.c_str(), before.empty() ? "-" : before.c_str(), after.empty() ? "-" : after.c_str());
+        }
+    }
+}
+
+void gui_run_history(run_history& history, const std::vector<run_change>& current) {
+    if (!gui_tree("Runs")) return;
+    ImGui::TextUnformatted("Current");
+    if (ImGui::IsItemHovered()) {
+        ImGui::BeginTooltip();
+        gui_changes(current);
+        ImGui::EndTooltip();
+    }
+    for (auto& run: history.runs | std::views::reverse) {
+        with_id id{run.number};
+        ImGui::Checkbox(frame_format("Run {}{}", run.number, run.spilled ? " (disk)" : ""), &run.overlay);
+        if (ImGui::IsItemHovered()) {
+            ImGui::BeginTooltip();
+            gui_changes(run.changes);
+            ImGui::EndTooltip();
+        }
+    }
+    ImGui::Text("%.1f MB", history.bytes()/1048576.0);
+    if (ImGui::SmallButton(frame_format("{} Clear", icon_clean))) history.clear();
+    ImGui::TreePop();
+}
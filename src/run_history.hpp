@@ -0,0 +1,69 @@
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "simulation.hpp"
+#include "task.hpp"
+#include "trace_store.hpp"
+
+// Flat description of a model, name -> value, for telling runs apart.
+using run_parameters = std::map<std::string, std::string>;
+
+struct run_change {
+    std::string name, before, after;
+};
+
+std::vector<run_change> diff_parameters(const run_parameters& before, const run_parameters& after);
+
+struct past_run {
+    size_t number = 0;
+    run_parameters parameters;
+    std::vector<run_change> changes; // Against the run before
+    std::map<std::pair<id_type, size_t>, size_t> keys; // (probe, location index) -> traces
+    std::vector<trace_store> traces;
+    std::optional<std::filesystem::path> spilled; // Traces live on disk instead
+    size_t last_used = 0;
+    size_t frame     = 0; // Last asked for
+    bool overlay = false;
+
+    size_t bytes() const;
+};
+
+// Earlier runs, oldest first. At most `capacity` are kept; beyond `budget`
+// bytes the least recently used are spilled to disk and read back on demand,
+// off-thread. Runs asked for in this or the last frame are never spilled, so
+// overlays beyond the budget exceed it instead of going back and forth.
+struct run_history {
+    size_t capacity = 8;
+    size_t budget   = size_t{256} << 20;
+    std::vector<past_run> runs;
+    size_t tick = 0;
+
+    run_history();
+    ~run_history();
+
+    void push(size_t number, run_parameters parameters, std::vector<run_change> changes, std::vector<trace>&& traces);
+    // Once per frame: take up runs read back from disk.
+    void poll();
+    // Trace of `probe` at location `index` in `run`; null while the run is read back from disk.
+    const trace_store* find(past_run& run, const id_type& probe, size_t index);
+    void clear();
+    size_t bytes() const;
+
+private:
+    std::filesystem::path spill_dir;
+    size_t frame = 0;
+    // Traces of run `number` being read back
+    size_t restoring_number = 0;
+    std::optional<task<std::vector<trace_store>>> restoring;
+
+    bool spill(past_run&); // False if the run stays in memory
+    void restore(past_run&);
+    void enforce_budget(const past_run* keep=nullptr);
+};
+
+void gui_run_history(run_history&, const std::vector<run_change>& current);
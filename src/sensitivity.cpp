@@ -0,0 +1,148 @@
+#include "sensitivity.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <fmt/format.h>
+#include <imgui.h>
+
+#include "fitter.hpp"
+#include "gui.hpp"
+#include "icons.hpp"
+
+trace_features measure_features(const model_run& run, const std::string& key, double threshold) {
+    trace_features result;
+    auto it = std::find_if(run.series.begin(), run.series.end(),
+                           [&](const auto& s) { return fmt::format("{}/{}", s.tag, s.index) == key; });
+    if (it == run.series.end() || it->values.empty()) return result;
+    const auto& vs = it->values;
+    auto sorted = vs;
+    std::nth_element(sorted.begin(), sorted.begin() + sorted.size()/2, sorted.end());
+    result.values = {*std::max_element(vs.begin(), vs.end()),
+                     double(threshold_crossings(it->times.data(), vs.data(), vs.size(), threshold).size()),
+                     sorted[sorted.size()/2]};
+    return result;
+}
+
+namespace {
+    // Zero values are moved by `step` itself instead.
+    double shift(double base, double step) { return base == 0.0 ? step : base*(1 + step); }
+}
+
+std::vector<std::vector<double>> sensitivity_variants(const std::vector<double>& bases, double step) {
+    std::vector<std::vector<double>> result{bases};
+    for (auto ix = 0ul; ix < bases.size(); ++ix) {
+        for (auto sign: {1.0, -1.0}) {
+            auto& variant = result.emplace_back(bases);
+            variant[ix] = shift(bases[ix], sign*step);
+        }
+    }
+    return result;
+}
+
+void poll_sensitivity(sensitivity& sens) {
+    if (!sens.running || !sens.running->ready()) return;
+    auto done = std::move(sens.running.value());
+    sens.running.reset();
+    std::vector<trace_features> features;
+    try {
+        features = done.get();
+    } catch (const task_cancelled&) {
+        return;
+    } catch (const std::exception& e) {
+        log_warn("Sensitivity analysis failed: {}", e.what());
+        sens.error = e.what();
+        return;
+    }
+    sens.error.clear();
+    sens.base = features.front();
+    sens.rows.clear();
+    for (auto ix = 0ul; ix < sens.running_values.size(); ++ix) {
+        auto b  = sens.running_bases[ix];
+        auto up = shift(b, sens.step), down = shift(b, -sens.step);
+        auto dp = (up - down)/(b == 0.0 ? 1.0 : std::abs(b));
+        auto& row = sens.rows.emplace_back();
+        row.value = sens.running_values[ix];
+        row.base  = b;
+        for (auto kx = 0ul; kx < row.sensitivities.size(); ++kx) {
+            auto f0 = sens.base.values[kx];
+            auto df = features[2*ix + 1].values[kx] - features[2*ix + 2].values[kx];
+            row.sensitivities[kx] = df/(f0 == 0.0 ? 1.0 : std::abs(f0))/dp;
+        }
+    }
+    sens.resort = true;
+}
+
+void gui_sensitivity(sensitivity& sens, const model_values_fn& available, const std::vector<std::string>& probes) {
+    if (!gui_tree("Sensitivity")) return;
+    {
+        with_item_width width(120.0f);
+        if (sens.probe.empty() && !probes.empty()) sens.probe = probes.front();
+        gui_choose("Probe", sens.probe, probes);
+        auto percent = 100*sens.step;
+        if (gui_input_double("Step", percent, "%")) sens.step = std::clamp(percent/100, 1e-6, 0.5);
+        gui_input_double("Threshold", sens.threshold, "mV");
+    }
+    if (ImGui::BeginListBox("##sensitivity-parameters", {-1, 120})) {
+        for (const auto& [value, current]: available()) {
+            auto it = std::find(sens.selected.begin(), sens.selected.end(), value);
+            auto on = it != sens.selected.end();
+            if (ImGui::Checkbox(frame_format("{}##{}", value.label, value.owner.value), &on)) {
+                if (on) sens.selected.push_back(value); else sens.selected.erase(it);
+            }
+        }
+        ImGui::EndListBox();
+    }
+    if (sens.running) {
+        auto& progress = sens.running->progress();
+        ImGui::ProgressBar(progress.total(), {-40.0f, 0.0f}, progress.label().c_str());
+        ImGui::SameLine();
+        if (ImGui::Button(icon_delete)) sens.running->cancel();
+    } else {
+        sens.should_run = ImGui::Button(frame_format("{} Analyse", icon_start));
+        gui_tooltip("Run the model and each parameter moved up and down as one simulation.");
+    }
+    if (!sens.error.empty()) ImGui::TextWrapped("%s %s", icon_error, sens.error.c_str());
+
+    constexpr auto flags = ImGuiTableFlags_RowBg | ImGuiTableFlags_Sortable | ImGuiTableFlags_SortTristate;
+    if (!sens.rows.empty() && ImGui::BeginTable("##sensitivities", 5, flags)) {
+        ImGui::TableSetupColumn("Parameter", ImGuiTableColumnFlags_DefaultSort);
+        ImGui::TableSetupColumn("Value", ImGuiTableColumnFlags_NoSort);
+        for (const auto& name: trace_features::names) ImGui::TableSetupColumn(name, ImGuiTableColumnFlags_PreferSortDescending);
+        ImGui::TableHeadersRow();
+        if (auto* specs = ImGui::TableGetSortSpecs(); specs && (specs->SpecsDirty || sens.resort)) {
+            if (specs->SpecsCount > 0) {
+                auto column = specs->Specs[0].ColumnIndex;
+                auto ascending = specs->Specs[0].SortDirection == ImGuiSortDirection_Ascending;
+                std::stable_sort(sens.rows.begin(), sens.rows.end(), [&](const auto& l, const auto& r) {
+                    if (column == 0) return ascending ? l.value.label < r.value.label : l.value.label > r.value.label;
+                    auto a = std::abs(l.sensitivities[column - 2]), b = std::abs(r.sensitivities[column - 2]);
+                    return ascending ? a < b : a > b;
+                });
+            }
+            specs->SpecsDirty = false;
+            sens.resort = false;
+        }
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted("(base)");
+        ImGui::TableNextColumn();
+        for (auto v: sens.base.values) {
+            ImGui::TableNextColumn();
+            ImGui::Text("%.4g", v);
+        }
+        for (const auto& row: sens.rows) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(row.value.label.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.4g", row.base);
+            for (auto s: row.sensitivities) {
+                ImGui::TableNextColumn();
+                ImGui::Text("%+.3f", s);
+            }
+        }
+        ImGui::EndTable();
+    }
+    ImGui::TreePop();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "simulation.hpp"
+#include "task.hpp"
+
+struct trace_features {
+    constexpr static std::array<const char*, 3> names{"Peak", "Spikes", "Rest"};
+    std::array<double, 3> values = {}; // Peak, spike count, resting level (median)
+};
+
+trace_features measure_features(const model_run&, const std::string& key, double threshold);
+
+struct sensitivity_row {
+    model_value value;
+    double base = 0.0;
+    std::array<double, 3> sensitivities = {}; // d ln(feature)/d ln(value), per feature
+};
+
+// Local sensitivity: each parameter is moved up and down by `step` (relative)
+// and all 2N+1 variants run as one batch.
+struct sensitivity {
+    double step      = 0.05;
+    double threshold = -20.0; // [mV]
+    std::string probe;        // "{tag}/{index}"
+    std::vector<model_value> selected;
+
+    bool should_run = false;
+    std::optional<task<std::vector<trace_features>>> running;
+    std::vector<model_value> running_values; // Parameters of the batch in flight
+    std::vector<double> running_bases;
+    trace_features base;
+    std::vector<sensitivity_row> rows;
+    bool resort = false; // Rows were rebuilt, apply the table's sort again
+    std::string error;
+};
+
+// Variant values: the base, then per parameter up and down.
+std::vector<std::vector<double>> sensitivity_variants(const std::vector<double>& bases, double step);
+void poll_sensitivity(sensitivity&);
+void gui_sensitivity(sensitivity&, const model_values_fn& available, const std::vector<std::string>& probes);
@@ -1,12 +1,230 @@
 #include "simulation.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <thread>
+#include <tuple>
+
+#include <implot.h>
+
+#include <arbor/context.hpp>
+#include <arbor/simulation.hpp>
+#include <arbor/units.hpp>
+
 #include "gui.hpp"
 #include "icons.hpp"
+#include "recipe.hpp"
+#include "utils.hpp"
+
+namespace U = arb::units;
+
+void spike_store::append(const std::vector<arb::spike>& spikes) {
+    gids.reserve(gids.size() + spikes.size());
+    lids.reserve(lids.size() + spikes.size());
+    times.reserve(times.size() + spikes.size());
+    rows.reserve(rows.size() + spikes.size());
+    for (const auto& spike: spikes) {
+        auto [it, _] = row_of.try_emplace({spike.source.gid, spike.source.index}, row_of.size());
+        gids.push_back(spike.source.gid);
+        lids.push_back(spike.source.index);
+        times.push_back(spike.time);
+        rows.push_back(it->second);
+    }
+}
 
-void gui_sim(simulation& sim) {
+void spike_store::clear() {
+    gids.clear(); lids.clear(); times.clear(); rows.clear(); row_of.clear();
+    rate_key = {size_t(-1), 0.0, 0.0};
+}
+
+const std::vector<float>& spike_store::rates(double bin, double until) const {
+    auto key = std::make_tuple(size(), bin, until);
+    if (key == rate_key) return rate_cache;
+    rate_key = key;
+    auto n_bins = bin > 0 ? size_t(std::ceil(until/bin)) : 0;
+    rate_cache.assign(n_bins, 0.0f);
+    if (!n_bins || row_of.empty()) return rate_cache;
+    for (const auto& t: times) {
+        auto ix = size_t(t/bin);
+        if (ix < n_bins) rate_cache[ix] += 1.0f;
+    }
+    auto scale = 1e3f/(bin*row_of.size());
+    for (auto& r: rate_cache) r *= scale;
+    return rate_cache;
+}
+
+void decode_samples(const arb::sample_record* samples, std::size_t n,
+                    std::vector<float>& times, std::vector<float>& values) {
+    if (!n) return;
+    times.reserve(times.size() + n);
+    if (arb::util::any_cast<const double*>(samples[0].data)) {
+        values.reserve(values.size() + n);
+        for (std::size_t i = 0; i < n; ++i) {
+            times.push_back(samples[i].time);
+            values.push_back(*static_cast<const double*>(samples[i].data.as<void*>()));
+        }
+    } else if (auto first = arb::util::any_cast<const arb::cable_sample_range*>(samples[0].data)) {
+        values.reserve(values.size() + n*(first->second - first->first));
+        for (std::size_t i = 0; i < n; ++i) {
+            times.push_back(samples[i].time);
+            auto [lo, hi] = *static_cast<const arb::cable_sample_range*>(samples[i].data.as<void*>());
+            values.insert(values.end(), lo, hi);
+        }
+    } else {
+        log_error("Unsupported sample type");
+    }
+}
+
+model_run run_model(const model& m, double until, double dt, const task_progress& progress) {
+    auto rec = make_recipe(m.properties, arb::cable_cell(m.morph, m.decor, m.labels));
+    rec.probes = m.probes;
+    auto sm = arb::simulation(rec, arb::make_context(arb::proc_allocation{1, -1}));
+
+    model_run result;
+    std::map<std::pair<std::string, unsigned>, size_t> index;
+    sm.add_sampler(arb::all_probes,
+                   arb::regular_schedule(dt * U::ms),
+                   [&](const arb::probe_metadata& pm, std::size_t n, const arb::sample_record* samples) {
+                       auto [it, fresh] = index.try_emplace({pm.id.tag, pm.index}, result.series.size());
+                       if (fresh) result.series.push_back({.tag=pm.id.tag, .index=pm.index});
+                       auto& s = result.series[it->second];
+                       decode_samples(samples, n, s.times, s.values);
+                   });
+    sm.set_global_spike_callback([&](const std::vector<arb::spike>& spikes) { result.spikes.append(spikes); });
+    sm.set_epoch_callback([&](double, double) { progress.check(); });
+    auto t0 = timer::now();
+    sm.run(until * U::ms, dt * U::ms);
+    result.runtime = std::chrono::duration<double>(timer::now() - t0).count();
+    std::sort(result.series.begin(), result.series.end(),
+              [](const auto& l, const auto& r) { return std::tie(l.tag, l.index) < std::tie(r.tag, r.index); });
+    return result;
+}
+
+double stream_batch(const std::vector<model>& models, double until, double dt, task_progress& progress,
+                    const batch_sampler& sampler, const batch_spikes& spikes) {
+    if (models.empty()) return 0.0;
+    const auto& base = models.front();
+    batch_recipe rec;
+    rec.properties = base.properties;
+    rec.probes     = base.probes;
+    for (const auto& m: models) {
+        progress.check();
+        rec.cells.emplace_back(base.morph, m.decor, base.labels);
+    }
+    auto n_threads = std::max(1u, std::thread::hardware_concurrency());
+    auto sm = arb::simulation(rec, arb::make_context(arb::proc_allocation{n_threads, -1}));
+    sm.add_sampler(arb::all_probes,
+                   arb::regular_schedule(dt * U::ms),
+                   [&](const arb::probe_metadata& pm, std::size_t n, const arb::sample_record* samples) {
+                       thread_local std::vector<float> times, values;
+                       times.clear();
+                       values.clear();
+                       decode_samples(samples, n, times, values);
+                       sampler(pm.id.gid, pm.id.tag, pm.index, times, values);
+                   });
+    if (spikes) sm.set_global_spike_callback(spikes);
+    // Cancelling throws out of the epoch callback on this thread
+    sm.set_epoch_callback([&](double t, double t_final) { progress.advance(1e3*t, 1e3*t_final); });
+    auto t0 = timer::now();
+    sm.run(until * U::ms, dt * U::ms);
+    return std::chrono::duration<double>(timer::now() - t0).count();
+}
+
+std::vector<model_run> run_batch(const std::vector<model>& models, double until, double dt, task_progress& progress) {
+    std::vector<model_run> result(models.size());
+    // Per cell, (tag, index) -> series; samplers of different cells may run concurrently.
+    std::vector<std::map<std::pair<std::string, unsigned>, size_t>> index(models.size());
+    std::vector<std::vector<arb::spike>> spikes(models.size());
+    auto runtime = stream_batch(models, until, dt, progress,
+                                [&](size_t gid, const std::string& tag, unsigned ix, const auto& times, const auto& values) {
+                                    auto& run = result[gid];
+                                    auto [it, fresh] = index[gid].try_emplace({tag, ix}, run.series.size());
+                                    if (fresh) run.series.push_back({.tag=tag, .index=ix});
+                                    auto& s = run.series[it->second];
+                                    s.times.insert(s.times.end(), times.begin(), times.end());
+                                    s.values.insert(s.values.end(), values.begin(), values.end());
+                                },
+                                [&](const std::vector<arb::spike>& batch) {
+                                    for (const auto& spike: batch) spikes[spike.source.gid].push_back(spike);
+                                });
+    for (auto gid = 0ul; gid < result.size(); ++gid) {
+        auto& run = result[gid];
+        run.spikes.append(spikes[gid]);
+        run.runtime = runtime;
+        std::sort(run.series.begin(), run.series.end(),
+                  [](const auto& l, const auto& r) { return std::tie(l.tag, l.index) < std::tie(r.tag, r.index); });
+    }
+    return result;
+}
+
+void gui_sim(simulation& sim, const std::vector<std::string>& ion_names, const std::vector<std::string>& state_variables) {
     with_item_width width(120.0f);
 
-    sim.should_run = ImGui::Button(fmt::format("{} Run", icon_start).c_str());
+    sim.should_run = ImGui::Button(frame_format("{} Run", icon_start));
     gui_input_double("End time",  sim.until, "ms");
     gui_input_double("Time step", sim.dt,    "ms");
+    ImGui::Checkbox("Compress traces", &sim.compress_traces);
+    gui_tooltip("Pack traces losslessly in blocks; slower to plot when zoomed out.");
+    ImGui::Checkbox("Export traces", &sim.export_traces);
+    gui_tooltip("Stream traces to .npy files plus a JSON description while running.");
+    if (sim.export_traces) {
+        with_indent indent;
+        ImGui::InputText("Directory", &sim.export_dir);
+        gui_tooltip("Each run goes to its own 'run-N' subdirectory.");
+        ImGui::Checkbox("Disk only", &sim.export_only);
+        gui_tooltip("Do not keep exported traces in memory.");
+    }
+    gui_choose("Cell-wide", sim.record_cell, simulation::cell_kinds);
+    gui_tooltip("Record every CV to play back on the morphology.");
+    if (sim.record_cell == "Internal Concentration" || sim.record_cell == "External Concentration") {
+        gui_choose("Ion Species##cell", sim.record_variable, ion_names);
+    } else if (sim.record_cell == "Mechanism State") {
+        gui_choose("State Variable##cell", sim.record_variable, state_variables);
+    }
+    if (sim.recording && !sim.recording->times.empty()) {
+        const auto& rec = *sim.recording;
+        if (ImGui::Button(sim.playing ? "Pause" : frame_format("{} Play", icon_start))) {
+            if (!sim.playing && sim.play_time >= rec.times.back()) sim.play_time = rec.times.front();
+            sim.playing = !sim.playing;
+        }
+        ImGui::SameLine();
+        auto t = float(sim.play_time);
+        if (ImGui::SliderFloat("##play-time", &t, rec.times.front(), rec.times.back(), "%.2f ms")) {
+            sim.play_time = t;
+            sim.playing   = false;
+        }
+        gui_input_double("Speed", sim.play_speed, "ms/s");
+        ImGui::Text("%s: %.3g - %.3g", rec.kind.c_str(), rec.lo, rec.hi);
+    }
+}
+
+void gui_spikes(simulation& sim) {
+    const auto& spikes = sim.spikes;
+    {
+        with_item_width width(120.0f);
+        gui_input_double("Bin", sim.rate_bin, "ms");
+        sim.rate_bin = std::max(sim.rate_bin, sim.dt);
+    }
+    ImGui::SameLine();
+    ImGui::Text("%zu spikes from %zu sources", spikes.size(), spikes.row_of.size());
+    static float ratios[] = {3.0f, 1.0f};
+    if (ImPlot::BeginSubplots("##spikes", 2, 1, {-1, -1}, ImPlotSubplotFlags_LinkAllX, ratios)) {
+        if (ImPlot::BeginPlot("##raster")) {
+            ImPlot::SetupAxes(nullptr, "Source");
+            ImPlot::SetupAxesLimits(0, sim.until, -0.5, spikes.row_of.size() - 0.5);
+            // One batched call for all spikes
+            ImPlot::SetNextMarkerStyle(ImPlotMarker_Square, 1.0f);
+            ImPlot::PlotScatter("Spikes", spikes.times.data(), spikes.rows.data(), spikes.size());
+            ImPlot::EndPlot();
+        }
+        if (ImPlot::BeginPlot("##rate")) {
+            const auto& rates = spikes.rates(sim.rate_bin, sim.until);
+            ImPlot::SetupAxes("Time (t/ms)", "Rate (f/Hz)");
+            ImPlot::SetupAxesLimits(0, sim.until, 0, 1, ImPlotCond_Once);
+            ImPlot::PlotStairs("Rate", rates.data(), rates.size(), sim.rate_bin);
+            ImPlot::EndPlot();
+        }
+        ImPlot::EndSubplots();
+    }
 }
@@ -1,26 +1,71 @@
 #pragma once
 
+#include <array>
+#include <functional>
+#include <map>
+#include <optional>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 #include <string>
 
+#include <arbor/cable_cell.hpp>
+#include <arbor/morph/label_dict.hpp>
+#include <arbor/morph/morphology.hpp>
+#include <arbor/morph/primitives.hpp>
+#include <arbor/recipe.hpp>
+#include <arbor/sampling.hpp>
+#include <arbor/spike.hpp>
+
 #include "id.hpp"
+#include "task.hpp"
+#include "trace_store.hpp"
 
 struct trace {
     std::string tag;
     id_type id;
+    id_type probe; // With generation; tags only carry the slot
     size_t index;
     double location;
     size_t branch;
     bool show = true;
-    std::vector<float> times;
-    std::vector<float> values;
+    trace_store data;
 
-    trace(const std::string t, const id_type i, size_t x, const double l, const size_t b):
-        tag{std::move(t)}, id{i}, index{x}, location{l}, branch{b}
+    trace(const std::string t, const id_type i, const id_type p, size_t x, const double l, const size_t b):
+        tag{std::move(t)}, id{i}, probe{p}, index{x}, location{l}, branch{b}
     {}
 };
 
+// Spikes in columns, one entry per spike; `rows` is the raster row of each spike,
+// so the columns can be handed to the plot as they are.
+struct spike_store {
+    std::vector<arb::cell_gid_type> gids;
+    std::vector<arb::cell_lid_type> lids;   // Detector on the cell
+    std::vector<float> times;               // [ms]
+    std::vector<float> rows;
+    std::map<std::pair<arb::cell_gid_type, arb::cell_lid_type>, size_t> row_of;
+
+    void append(const std::vector<arb::spike>&);
+    void clear();
+    size_t size() const { return times.size(); }
+    // Population rate per bin of width `bin` [ms] over [0, until), in Hz per source.
+    const std::vector<float>& rates(double bin, double until) const;
+
+private:
+    mutable std::vector<float> rate_cache;
+    mutable std::tuple<size_t, double, double> rate_key = {size_t(-1), 0.0, 0.0};
+};
+
+// Cell-wide recording with one value per cable and sample.
+struct cell_recording {
+    std::string kind;
+    arb::mcable_list cables;
+    std::vector<float> times;
+    std::vector<float> values; // [sample][cable]
+    float lo = 0.0f, hi = 0.0f;
+
+    const float* at(size_t sample) const { return values.data() + sample*cables.size(); }
+};
 
 struct simulation {
     double until = 100;
@@ -30,7 +75,91 @@ struct simulation {
     bool show_trace = false;
 
     std::unordered_map<std::string, id_type> tag_to_id;
+    std::vector<std::string> trace_keys; // Of `tag_to_id`, sorted; set once a run ends
     std::vector<trace> traces;
+    bool compress_traces = false;
+    // Stream traces to disk while running
+    bool export_traces = false;
+    bool export_only   = false; // Keep nothing in memory
+    std::string export_dir = "traces";
+    std::optional<std::string> exported_only; // Directory the last run went to, if kept on disk only
+    std::string error;                        // Of the last run
+    spike_store spikes;
+    double rate_bin = 5.0; // [ms]
+
+    // Cell-wide recording and its playback onto the morphology
+    constexpr static std::array<const char*, 6> cell_kinds{"Off", "Voltage", "Membrane Current", "Internal Concentration", "External Concentration", "Mechanism State"};
+    std::string record_cell = cell_kinds.front();
+    std::string record_variable;  // Ion or 'cat::mech::state', as for probes
+    std::optional<cell_recording> recording;
+    bool   playing    = false;
+    double play_time  = 0.0;   // [ms]
+    double play_speed = 10.0;  // [ms/s]
+    size_t play_sample = -1;   // Sample currently uploaded
+};
+
+// Everything needed to simulate the cell, detached from the GUI state so it can
+// be copied to and run on workers.
+struct model {
+    arb::morphology morph;
+    arb::decor decor;
+    arb::label_dict labels;
+    arb::cable_cell_global_properties properties;
+    std::vector<arb::probe_info> probes;
 };
 
-void gui_sim(simulation&);
+// Samples of one probe location.
+struct probe_series {
+    std::string tag;
+    unsigned index = 0;
+    std::vector<float> times;
+    std::vector<float> values;
+};
+
+struct model_run {
+    std::vector<probe_series> series; // Sorted by (tag, index)
+    spike_store spikes;
+    double runtime = 0.0;       // Wall clock of the simulation proper, seconds
+};
+
+// Append a batch of scalar or cable-range samples; the value type is checked
+// once per batch, not per sample.
+void decode_samples(const arb::sample_record* samples, std::size_t n,
+                    std::vector<float>& times, std::vector<float>& values);
+
+// Run on a single thread; callers run several models in parallel instead.
+// Throws `task_cancelled` between epochs once `progress` is cancelled.
+model_run run_model(const model&, double until, double dt, const task_progress&);
+// Run all models as one multi-cell simulation on all cores, one result per model.
+// Morphology, labels, properties, and probes are taken from the first model;
+// the models differ only in their decor.
+std::vector<model_run> run_batch(const std::vector<model>&, double until, double dt, task_progress&);
+// Decoded samples of model `gid`'s probe (tag, index), in time order per probe.
+using batch_sampler = std::function<void(size_t gid, const std::string& tag, unsigned index,
+                                         const std::vector<float>& times, const std::vector<float>& values)>;
+using batch_spikes = std::function<void(const std::vector<arb::spike>&)>;
+// As `run_batch`, but samples are handed over as they arrive instead of kept;
+// calls for different models may come from several threads at once. Returns
+// the wall clock of the simulation proper, seconds.
+double stream_batch(const std::vector<model>&, double until, double dt, task_progress&,
+                    const batch_sampler&, const batch_spikes& = {});
+
+// One number of the model as set in the GUI: a region's TK, Cm, Vm or RL, a
+// mechanism's parameter or global, or an ion's default Xi, Xo or Er.
+struct model_value {
+    enum kind_type { region, mechanism, ion } kind = region;
+    id_type owner;      // Region, mechanism, or ion
+    std::string name;
+    std::string label;  // For display
+
+    bool operator==(const model_value& o) const { return kind == o.kind && owner == o.owner && name == o.name; }
+};
+
+// Values of the model with their current settings, built on the first call;
+// panels only ask while open.
+using model_values_fn = std::function<const std::vector<std::pair<model_value, double>>&()>;
+// Decor of the model with `values` in place of some model values; safe to call off the render thread.
+using variant_decor_fn = std::function<arb::decor(const std::vector<double>& values)>;
+
+void gui_sim(simulation&, const std::vector<std::string>& ion_names, const std::vector<std::string>& state_variables);
+void gui_spikes(simulation&);
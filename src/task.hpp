@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Thrown inside a task body once the owner asked it to stop.
+struct task_cancelled: std::exception {
+    const char* what() const noexcept override { return "Cancelled."; }
+};
+
+// Progress shared between a worker and the render thread.
+struct task_progress {
+    std::vector<std::string> stages;
+    std::atomic<size_t> stage    = 0;
+    std::atomic<float>  fraction = 0.0f;
+    std::atomic<bool>   cancel   = false;
+
+    task_progress(std::vector<std::string> s): stages{std::move(s)} {}
+
+    // Move on to stage `s`, bail out if cancelled.
+    void enter(size_t s) { check(); stage = s; fraction = 0.0f; }
+    // Report progress within the current stage, bail out if cancelled.
+    void advance(size_t done, size_t total) { check(); fraction = total ? float(done)/float(total) : 1.0f; }
+    void check() const { if (cancel) throw task_cancelled{}; }
+
+    const std::string& label() const {
+        static const std::string none;
+        return stages.empty() ? none : stages[std::min(stage.load(), stages.size() - 1)];
+    }
+    float total() const { return stages.empty() ? 1.0f : (stage + fraction)/stages.size(); }
+};
+
+// Called on the worker once a task is done, eg to wake up a render loop waiting
+// for events. Clear it before what it calls into goes away.
+inline std::atomic<void (*)()> task_done_hook = nullptr;
+
+// Workers of all tasks, so none outlives `main`: `join` cancels them and waits.
+struct task_workers {
+    struct worker {
+        std::thread thread;
+        std::shared_ptr<task_progress> progress;
+        std::shared_ptr<const std::atomic<bool>> finished;
+    };
+    std::mutex mutex;
+    std::vector<worker> workers;
+
+    void add(worker w) {
+        std::lock_guard<std::mutex> lock{mutex};
+        // Reap the ones that are through
+        std::erase_if(workers, [](auto& old) {
+            if (!*old.finished) return false;
+            old.thread.join();
+            return true;
+        });
+        workers.push_back(std::move(w));
+    }
+
+    // Tasks that never check for cancellation run to their end.
+    void join() {
+        std::vector<worker> all;
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            all = std::exchange(workers, {});
+        }
+        for (auto& w: all) w.progress->cancel = true;
+        for (auto& w: all) w.thread.join();
+    }
+
+    ~task_workers() { join(); }
+};
+
+inline task_workers all_tasks;
+
+// Run a body `T(task_progress&)` on a worker; poll `ready` from the render thread.
+// Abandoned or cancelled tasks finish on their own, their result is dropped.
+template<typename T>
+struct task {
+    struct shared {
+        task_progress      progress;
+        std::mutex         mutex;
+        std::optional<T>   result;
+        std::exception_ptr error;
+        bool               done = false;
+        std::atomic<bool>  finished = false; // Worker is about to exit
+
+        shared(std::vector<std::string> stages): progress{std::move(stages)} {}
+    };
+
+    template<typename F>
+    task(std::vector<std::string> stages, F body): state{std::make_shared<shared>(std::move(stages))} {
+        std::thread worker([state=state, body=std::move(body)]() mutable {
+            std::optional<T> result;
+            std::exception_ptr error;
+            try {
+                result.emplace(body(state->progress));
+            } catch (...) {
+                error = std::current_exception();
+            }
+            {
+                std::lock_guard<std::mutex> lock{state->mutex};
+                state->result = std::move(result);
+                state->error  = error;
+                state->done   = true;
+            }
+            if (auto hook = task_done_hook.load()) hook();
+            state->finished = true;
+        });
+        all_tasks.add({.thread=std::move(worker),
+                       .progress=std::shared_ptr<task_progress>(state, &state->progress),
+                       .finished=std::shared_ptr<const std::atomic<bool>>(state, &state->finished)});
+    }
+
+    bool ready() {
+        std::lock_guard<std::mutex> lock{state->mutex};
+        return state->done;
+    }
+
+    // Take the result; rethrows whatever the body threw.
+    T get() {
+        std::lock_guard<std::mutex> lock{state->mutex};
+        if (state->error) std::rethrow_exception(state->error);
+        return std::move(state->result.value());
+    }
+
+    void cancel() { state->progress.cancel = true; }
+    task_progress& progress() { return state->progress; }
+
+    std::shared_ptr<shared> state;
+};
+
+// Run `f(ix)` for ix in [0, n) on all cores, handing out `grain` indices at a time.
+// The first exception thrown by any `f` is rethrown on the caller.
+template<typename F>
+void parallel_for(size_t n, F&& f, size_t grain=1) {
+    grain = std::max<size_t>(grain, 1);
+    auto n_batches = (n + grain - 1)/grain;
+    auto n_threads = std::min<size_t>(n_batches, std::max(1u, std::thread::hardware_concurrency()));
+    if (n_threads <= 1) {
+        for (size_t ix = 0; ix < n; ++ix) f(ix);
+        return;
+    }
+    std::atomic<size_t> next = 0;
+    std::vector<std::exception_ptr> errors(n_threads);
+    std::vector<std::thread> workers;
+    for (size_t tid = 0; tid < n_threads; ++tid) {
+        workers.emplace_back([&, tid]() {
+            try {
+                for (auto batch = next++; batch < n_batches; batch = next++) {
+                    for (auto ix = batch*grain; ix < std::min(n, (batch + 1)*grain); ++ix) f(ix);
+                }
+            } catch (...) {
+                errors[tid] = std::current_exception();
+                next = n_batches;
+            }
+        });
+    }
+    for (auto& worker: workers) worker.join();
+    for (const auto& error: errors) {
+        if (error) std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,106 @@
+#include "trace_export.hpp"
+
+#include <bit>
+#include <cstdint>
+
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+
+#include "utils.hpp"
+
+namespace {
+    constexpr auto npy_descr = std::endian::native == std::endian::little ? "<f4" : ">f4";
+    // Header incl. magic, padded to a multiple of 64 as the format asks; the
+    // shape is printed at fixed width, so the header never changes size.
+    std::string npy_header(size_t count) {
+        auto dict = fmt::format("{{'descr': '{}', 'fortran_order': False, 'shape': ({:>20},), }}", npy_descr, count);
+        auto size = 10 + dict.size() + 1;
+        dict.append((64 - size % 64) % 64, ' ');
+        dict.push_back('\n');
+        std::string result("\x93NUMPY\x01\x00", 8);
+        result.push_back(char(dict.size() & 0xff));
+        result.push_back(char(dict.size() >> 8));
+        return result + dict;
+    }
+}
+
+trace_export::trace_export(const std::filesystem::path& d): dir{d} {
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) log_error("Cannot create export directory {}: {}", dir.string(), ec.message());
+    for (auto it = std::filesystem::directory_iterator(dir, ec); !ec && it != std::filesystem::directory_iterator{}; it.increment(ec)) {
+        const auto& path = it->path();
+        std::error_code rm;
+        if (path.extension() == ".npy" || path.filename() == "traces.json") std::filesystem::remove(path, rm);
+    }
+    log_info("Exporting traces to {}", dir.string());
+}
+
+trace_export::~trace_export() {
+    try {
+        finish();
+    } catch (const std::exception& e) {
+        log_warn("Trace export incomplete: {}", e.what());
+    }
+}
+
+size_t trace_export::add(const trace_meta& meta) {
+    auto& e = entries.emplace_back();
+    e.meta = meta;
+    auto stem = fmt::format("{}_{}", meta.probe, meta.index);
+    open(e.times,  stem + "_t.npy");
+    open(e.values, stem + "_v.npy");
+    return entries.size() - 1;
+}
+
+void trace_export::write(size_t trace, const std::vector<float>& times, const std::vector<float>& values) {
+    auto& e = entries.at(trace);
+    append(e.times,  times);
+    append(e.values, values);
+}
+
+void trace_export::open(column& c, const std::string& name) {
+    c.path = dir / name;
+    c.out.open(c.path, std::ios::binary | std::ios::trunc);
+    if (!c.out) log_error("Cannot open {} for writing", c.path.string());
+    write_header(c);
+}
+
+void trace_export::append(column& c, const std::vector<float>& xs) {
+    c.out.write(reinterpret_cast<const char*>(xs.data()), xs.size()*sizeof(float));
+    if (!c.out) log_error("Writing {} failed", c.path.string());
+    c.count += xs.size();
+}
+
+void trace_export::write_header(column& c) {
+    auto header = npy_header(c.count);
+    auto pos = c.out.tellp();
+    c.out.seekp(0);
+    c.out.write(header.data(), header.size());
+    if (pos > std::streamoff(header.size())) c.out.seekp(pos);
+}
+
+void trace_export::finish() {
+    if (done) return;
+    done = true;
+    auto traces = nlohmann::json::array();
+    for (auto& e: entries) {
+        for (auto* c: {&e.times, &e.values}) {
+            write_header(*c);
+            c->out.close();
+        }
+        traces.push_back({{"probe",    e.meta.probe},
+                          {"index",    e.meta.index},
+                          {"kind",     e.meta.kind},
+                          {"variable", e.meta.variable},
+                          {"branch",   e.meta.branch},
+                          {"position", e.meta.position},
+                          {"samples",  e.times.count},
+                          {"times",    e.times.path.filename().string()},
+                          {"values",   e.values.path.filename().string()}});
+    }
+    std::ofstream fd(dir / "traces.json");
+    fd << nlohmann::json{{"traces", traces}}.dump(2) << '\n';
+    if (!fd) log_error("Cannot write {}", (dir / "traces.json").string());
+    log_info("Exported {} traces to {}", entries.size(), dir.string());
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct trace_meta {
+    std::string probe;     // Probe tag
+    size_t index = 0;      // Location within the probe's locset
+    std::string kind;
+    std::string variable;
+    size_t branch = 0;
+    double position = 0.0;
+};
+
+// Streams traces into `dir` while the sampler runs: per trace a pair of float32
+// .npy columns, `<probe>_<index>_t.npy` and `..._v.npy`, plus `traces.json`
+// describing them. Samples are written as they arrive; the .npy headers leave
+// room for the length, which is patched in by `finish`. Columns and sidecars
+// left in `dir` by an earlier export are removed first.
+struct trace_export {
+    explicit trace_export(const std::filesystem::path& dir);
+    ~trace_export();
+
+    const std::filesystem::path& directory() const { return dir; }
+    size_t add(const trace_meta&);
+    void write(size_t trace, const std::vector<float>& times, const std::vector<float>& values);
+    // Fix up headers and write the sidecar; called by the destructor otherwise.
+    void finish();
+
+private:
+    struct column {
+        std::filesystem::path path;
+        std::ofstream out;
+        size_t count = 0;
+    };
+    struct entry {
+        trace_meta meta;
+        column times, values;
+    };
+
+    std::filesystem::path dir;
+    std::vector<entry> entries;
+    bool done = false;
+
+    void open(column&, const std::string& name);
+    void append(column&, const std::vector<float>&);
+    void write_header(column&);
+};
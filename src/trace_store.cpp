@@ -0,0 +1,246 @@
+#include "trace_store.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <optional>
+
+namespace {
+    constexpr std::uint64_t mask(unsigned n) { return n >= 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << n) - 1; }
+
+    // MSB-first bit stream over 64b words.
+    struct bit_writer {
+        std::vector<std::uint64_t>& words;
+        size_t& n_bits;
+
+        void put(std::uint64_t value, unsigned n) {
+            value &= mask(n);
+            auto offset = n_bits % 64;
+            if (offset == 0) words.push_back(0);
+            auto room = 64 - offset;
+            if (n <= room) {
+                words.back() |= value << (room - n);
+            } else {
+                words.back() |= value >> (n - room);
+                words.push_back(value << (64 - (n - room)));
+            }
+            n_bits += n;
+        }
+    };
+
+    struct bit_reader {
+        const std::vector<std::uint64_t>& words;
+        size_t pos = 0;
+
+        std::uint64_t get(unsigned n) {
+            auto word   = pos/64;
+            auto room   = 64 - pos % 64;
+            pos += n;
+            if (n <= room) return (words[word] >> (room - n)) & mask(n);
+            auto rest = n - room;
+            return ((words[word] & mask(room)) << rest) | (words[word + 1] >> (64 - rest));
+        }
+    };
+
+    std::uint32_t zigzag(std::int32_t x) { return (std::uint32_t(x) << 1) ^ std::uint32_t(x >> 31); }
+    std::int32_t unzigzag(std::uint32_t x) { return std::int32_t(x >> 1) ^ -std::int32_t(x & 1); }
+
+    // Delta-of-delta classes: prefix, prefix length, payload width
+    struct dod_class { std::uint32_t prefix; unsigned length, width; };
+    constexpr dod_class dod_classes[] = {{0b10, 2, 7}, {0b110, 3, 9}, {0b1110, 4, 12}, {0b1111, 4, 32}};
+
+    void pack_block(const float* ts, const float* vs, size_t n, bit_writer& out) {
+        auto t_prev = std::bit_cast<std::uint32_t>(ts[0]);
+        auto v_prev = std::bit_cast<std::uint32_t>(vs[0]);
+        out.put(t_prev, 32);
+        out.put(v_prev, 32);
+        std::int32_t delta = 0;
+        unsigned lead = 33, trail = 0; // No window yet
+        for (auto ix = 1ul; ix < n; ++ix) {
+            // Time: regular steps have constant bit pattern deltas within an exponent
+            auto t = std::bit_cast<std::uint32_t>(ts[ix]);
+            auto d = std::int32_t(t - t_prev);
+            auto dod = zigzag(std::int32_t(std::uint32_t(d) - std::uint32_t(delta)));
+            if (dod == 0) {
+                out.put(0, 1);
+            } else {
+                for (const auto& c: dod_classes) {
+                    if (c.width < 32 && dod >= (std::uint32_t{1} << c.width)) continue;
+                    out.put(c.prefix, c.length);
+                    out.put(dod, c.width);
+                    break;
+                }
+            }
+            t_prev = t;
+            delta  = d;
+            // Value: XOR with predecessor, reuse the previous window of meaningful bits if it fits
+            auto v = std::bit_cast<std::uint32_t>(vs[ix]);
+            auto x = v ^ v_prev;
+            v_prev = v;
+            if (x == 0) {
+                out.put(0, 1);
+                continue;
+            }
+            out.put(1, 1);
+            unsigned l = std::min(std::countl_zero(x), 31), r = std::countr_zero(x);
+            if (l >= lead && r >= trail) {
+                out.put(0, 1);
+                out.put(x >> trail, 32 - lead - trail);
+            } else {
+                lead = l; trail = r;
+                auto length = 32 - lead - trail;
+                out.put(1, 1);
+                out.put(lead, 5);
+                out.put(length - 1, 5);
+                out.put(x >> trail, length);
+            }
+        }
+    }
+
+    void unpack_block(const std::vector<std::uint64_t>& bits, size_t n, std::vector<float>& ts, std::vector<float>& vs) {
+        bit_reader in{bits};
+        auto t = std::uint32_t(in.get(32));
+        auto v = std::uint32_t(in.get(32));
+        ts.push_back(std::bit_cast<float>(t));
+        vs.push_back(std::bit_cast<float>(v));
+        std::int32_t delta = 0;
+        unsigned lead = 0, trail = 0;
+        for (auto ix = 1ul; ix < n; ++ix) {
+            if (in.get(1)) {
+                auto c = 0ul;
+                while (c < std::size(dod_classes) - 1 && in.get(1)) ++c;
+                delta = std::int32_t(std::uint32_t(delta) + std::uint32_t(unzigzag(std::uint32_t(in.get(dod_classes[c].width)))));
+            }
+            t += std::uint32_t(delta);
+            if (in.get(1)) {
+                if (in.get(1)) {
+                    lead  = in.get(5);
+                    trail = 32 - lead - (in.get(5) + 1);
+                }
+                v ^= std::uint32_t(in.get(32 - lead - trail)) << trail;
+            }
+            ts.push_back(std::bit_cast<float>(t));
+            vs.push_back(std::bit_cast<float>(v));
+        }
+    }
+}
+
+void trace_store::append(const std::vector<float>& ts, const std::vector<float>& vs) {
+    auto n = std::min(ts.size(), vs.size());
+    for (auto ix = 0ul; ix < n; ++ix) {
+        lo = std::min(lo, vs[ix]);
+        hi = std::max(hi, vs[ix]);
+    }
+    auto ix = 0ul;
+    if (compress) {
+        // Top up the open tail, then pack whole blocks straight from the batch
+        if (!times.empty()) {
+            ix = std::min(n, block_size - times.size());
+            times.insert(times.end(), ts.begin(), ts.begin() + ix);
+            values.insert(values.end(), vs.begin(), vs.begin() + ix);
+            if (times.size() == block_size) {
+                pack(times.data(), values.data());
+                times.clear();
+                values.clear();
+            }
+        }
+        for (; ix + block_size <= n; ix += block_size) pack(ts.data() + ix, vs.data() + ix);
+    }
+    times.insert(times.end(), ts.begin() + ix, ts.begin() + n);
+    values.insert(values.end(), vs.begin() + ix, vs.begin() + n);
+}
+
+void trace_store::pack(const float* ts, const float* vs) {
+    auto& b = blocks.emplace_back();
+    b.t_first = ts[0];
+    b.t_last  = ts[block_size - 1];
+    bit_writer out{b.bits, b.n_bits};
+    pack_block(ts, vs, block_size, out);
+    b.bits.shrink_to_fit();
+    n_packed += block_size;
+}
+
+void trace_store::clear() {
+    auto keep = compress;
+    *this = trace_store{};
+    compress = keep;
+}
+
+size_t trace_store::bytes() const {
+    auto result = (times.capacity() + values.capacity())*sizeof(float);
+    for (const auto& b: blocks) result += sizeof(block) + b.bits.capacity()*sizeof(std::uint64_t);
+    return result;
+}
+
+void trace_store::copy(std::vector<float>& ts, std::vector<float>& vs) const {
+    ts.clear();
+    vs.clear();
+    ts.reserve(size());
+    vs.reserve(size());
+    for (const auto& b: blocks) unpack_block(b.bits, block_size, ts, vs);
+    ts.insert(ts.end(), times.begin(), times.end());
+    vs.insert(vs.end(), values.begin(), values.end());
+}
+
+void trace_store::decimate(double t0, double t1, size_t buckets, std::vector<float>& ts, std::vector<float>& vs) const {
+    ts.clear();
+    vs.clear();
+    auto scale = t1 > t0 ? buckets/(t1 - t0) : 0.0;
+    // Extremes of the current bucket, emitted in time order when it closes
+    struct sample { float t, v; };
+    sample min, max;
+    long current = 0;
+    bool open = false;
+    auto flush = [&] {
+        if (!open) return;
+        auto [a, b] = min.t <= max.t ? std::make_pair(min, max) : std::make_pair(max, min);
+        ts.push_back(a.t); vs.push_back(a.v);
+        if (a.t != b.t) { ts.push_back(b.t); vs.push_back(b.v); }
+    };
+    auto add = [&](sample s) {
+        auto bucket = std::clamp<long>((s.t - t0)*scale, -1, buckets);
+        if (!open || bucket != current) {
+            flush();
+            open    = true;
+            current = bucket;
+            min = max = s;
+            return;
+        }
+        if (s.v < min.v) min = s;
+        if (s.v > max.v) max = s;
+    };
+    // Feed samples in time order; keep the last one before t0, stop after the first past t1
+    std::optional<sample> before;
+    bool done = false;
+    auto feed = [&](const float* xs, const float* ys, size_t n) {
+        auto ix = std::max<long>(std::lower_bound(xs, xs + n, float(t0)) - xs - 1, 0);
+        for (; ix < long(n) && !done; ++ix) {
+            sample s{xs[ix], ys[ix]};
+            if (s.t < t0) {
+                before = s;
+                continue;
+            }
+            if (before) add(*std::exchange(before, std::nullopt));
+            add(s);
+            done = s.t > t1;
+        }
+    };
+    if (!blocks.empty()) {
+        // Blocks overlapping [t0, t1], widened by one to pick up the neighbours
+        auto first = std::lower_bound(blocks.begin(), blocks.end(), t0, [](const auto& b, double t) { return b.t_last < t; }) - blocks.begin();
+        auto last  = std::upper_bound(blocks.begin(), blocks.end(), t1, [](double t, const auto& b) { return t < b.t_first; }) - blocks.begin();
+        first = std::max(first - 1, 0l);
+        last  = std::min<long>(last + 1, blocks.size());
+        std::vector<float> bts, bvs;
+        bts.reserve(block_size);
+        bvs.reserve(block_size);
+        for (auto ix = first; ix < last && !done; ++ix) {
+            bts.clear();
+            bvs.clear();
+            unpack_block(blocks[ix].bits, block_size, bts, bvs);
+            feed(bts.data(), bvs.data(), block_size);
+        }
+    }
+    feed(times.data(), values.data(), times.size());
+    if (before) add(*before);
+    flush();
+}
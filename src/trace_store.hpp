@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Samples (t, v) of one trace. Plain columns by default; with `compress` set,
+// full blocks of `block_size` samples are packed: times as delta-of-delta over
+// their bit patterns, values XORed against their predecessor. Both are
+// lossless. Only the open tail of fewer than `block_size` samples stays
+// unpacked; readers unpack one block at a time.
+struct trace_store {
+    constexpr static size_t block_size = 1024;
+
+    bool compress = false;
+
+    void append(const std::vector<float>& ts, const std::vector<float>& vs);
+    // Drop all samples and release their memory.
+    void clear();
+
+    size_t size() const { return n_packed + times.size(); }
+    size_t bytes() const;
+    std::pair<float, float> range() const { return {lo, hi}; }
+
+    // Everything, unpacked into `ts` and `vs`.
+    void copy(std::vector<float>& ts, std::vector<float>& vs) const;
+    // Samples in [t0, t1], plus one neighbour either side, reduced to the min
+    // and max of each of `buckets` equal time bins, in time order. Overlays
+    // decimated to the same bins line up.
+    void decimate(double t0, double t1, size_t buckets, std::vector<float>& ts, std::vector<float>& vs) const;
+
+private:
+    struct block {
+        float t_first, t_last;
+        size_t n_bits = 0;
+        std::vector<std::uint64_t> bits;
+    };
+
+    std::vector<block> blocks;
+    size_t n_packed = 0;
+    std::vector<float> times, values; // Open tail; all samples if not compressing
+    float lo = std::numeric_limits<float>::max(), hi = std::numeric_limits<float>::lowest();
+
+    void pack(const float* ts, const float* vs);
+};
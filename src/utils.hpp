@@ -4,6 +4,7 @@
 #include <sstream>
 #include <fstream>
 #include <filesystem>
+#include <vector>
 
 #include "glm/glm.hpp"
 #include "imgui.h"
@@ -109,4 +110,12 @@ inline std::string split_off(std::string& str, const std::string& by) {
   return result;
 }
 
+template<typename T>
+std::vector<T*> to_pointers(std::vector<T>& items) {
+  std::vector<T*> result;
+  result.reserve(items.size());
+  for (auto& item: items) result.push_back(&item);
+  return result;
+}
+
 glm::vec4 next_color();
@@ -31,7 +31,23 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     if ((key == GLFW_KEY_EQUAL) && (action == GLFW_PRESS)) delta_zoom  = -2.0f;
 }
 
-bool Window::visible() { return glfwGetWindowAttrib(handle, GLFW_FOCUSED); }
+// Unfocused windows keep rendering, so background progress remains visible.
+bool Window::visible() { return glfwGetWindowAttrib(handle, GLFW_VISIBLE) && !glfwGetWindowAttrib(handle, GLFW_ICONIFIED); }
+
+void Window::wait(double timeout) { glfwWaitEventsTimeout(timeout); }
+
+void Window::wake() { glfwPostEmptyEvent(); }
+
+bool Window::interacting() {
+    const auto& io = ImGui::GetIO();
+    return ImGui::IsAnyItemActive()
+        || ImGui::IsMouseDown(ImGuiMouseButton_Left)
+        || ImGui::IsMouseDown(ImGuiMouseButton_Right)
+        || ImGui::IsMouseDown(ImGuiMouseButton_Middle)
+        || io.MouseWheel != 0.0f
+        || io.MouseDelta.x != 0.0f
+        || io.MouseDelta.y != 0.0f;
+}
 
 Window::Window() {
     glfwSetErrorCallback(glfw_error_callback);
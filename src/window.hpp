@@ -24,12 +24,19 @@ struct Window {
 
     bool running();
     bool visible();
+    // Block until input arrives, `wake` is called, or `timeout` passed.
+    void wait(double timeout);
+    // Whether the last frame had ongoing interaction, eg dragging or typing.
+    bool interacting();
     void begin_frame();
     void end_frame();
 
     void set_style_dark();
     void set_style_light();
 
+    // Thread-safe; interrupts `wait`.
+    static void wake();
+
     private:
         ImFont* font = nullptr;
         std::string ini_file = "";